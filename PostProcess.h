@@ -17,6 +17,14 @@ private:
     std::shared_ptr<Shader> blurShader;
     std::shared_ptr<Shader> combineShader;
 
+    static constexpr UniformId thresholdUniform{ "threshold" };
+    static constexpr UniformId screenTextureUniform{ "screenTexture" };
+    static constexpr UniformId horizontalUniform{ "horizontal" };
+    static constexpr UniformId inputTextureUniform{ "inputTexture" };
+    static constexpr UniformId bloomStrengthUniform{ "bloomStrength" };
+    static constexpr UniformId sceneTextureUniform{ "sceneTexture" };
+    static constexpr UniformId bloomTextureUniform{ "bloomTexture" };
+
     void checkFramebufferStatus() const {
         GLenum status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
         if (status != GL_FRAMEBUFFER_COMPLETE) {
@@ -48,11 +56,11 @@ public:
 
         // HDR framebuffer setup
         glGenFramebuffers(1, &hdrFBO);
-        glBindFramebuffer(GL_FRAMEBUFFER, hdrFBO);
+        GLState::instance().bindFramebuffer(hdrFBO);
 
         // Color buffer
         glGenTextures(1, &colorBuffer);
-        glBindTexture(GL_TEXTURE_2D, colorBuffer);
+        GLState::instance().bindTextureForUpdate(GL_TEXTURE_2D, colorBuffer);
         glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB16F, width, height, 0, GL_RGB, GL_FLOAT, nullptr);
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
@@ -60,7 +68,7 @@ public:
 
         // Bright buffer
         glGenTextures(1, &brightBuffer);
-        glBindTexture(GL_TEXTURE_2D, brightBuffer);
+        GLState::instance().bindTextureForUpdate(GL_TEXTURE_2D, brightBuffer);
         glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB16F, width, height, 0, GL_RGB, GL_FLOAT, nullptr);
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
@@ -80,14 +88,14 @@ public:
         if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
             throw std::runtime_error("HDR Framebuffer not complete!");
         }
-        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        GLState::instance().bindFramebuffer(0);
 
         // Pingpong framebuffers
         glGenFramebuffers(2, pingpongFBO);
         glGenTextures(2, pingpongColorbuffers);
         for (unsigned int i = 0; i < 2; ++i) {
-            glBindFramebuffer(GL_FRAMEBUFFER, pingpongFBO[i]);
-            glBindTexture(GL_TEXTURE_2D, pingpongColorbuffers[i]);
+            GLState::instance().bindFramebuffer(pingpongFBO[i]);
+            GLState::instance().bindTextureForUpdate(GL_TEXTURE_2D, pingpongColorbuffers[i]);
             glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB16F, width, height, 0, GL_RGB, GL_FLOAT, nullptr);
             glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
             glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
@@ -98,24 +106,23 @@ public:
                 throw std::runtime_error("Pingpong Framebuffer not complete!");
             }
         }
-        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        GLState::instance().bindFramebuffer(0);
 
         checkOpenGLError();
     }
 
     void BeginRender() {
-        glBindFramebuffer(GL_FRAMEBUFFER, hdrFBO);
+        GLState::instance().bindFramebuffer(hdrFBO);
         glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
     }
 
     void ApplyBloom(float threshold, float bloomStrength) {
         // Brightness extraction
         brightShader->use();
-        brightShader->setFloat("threshold", threshold);
-        brightShader->setInt("screenTexture", 0);
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_2D, colorBuffer);
-        glBindFramebuffer(GL_FRAMEBUFFER, pingpongFBO[0]);
+        brightShader->set(thresholdUniform, threshold);
+        brightShader->set(screenTextureUniform, 0);
+        GLState::instance().bindTexture(0, GL_TEXTURE_2D, colorBuffer);
+        GLState::instance().bindFramebuffer(pingpongFBO[0]);
         glClear(GL_COLOR_BUFFER_BIT);
         renderQuad();
 
@@ -123,12 +130,11 @@ public:
         bool horizontal = true, firstIteration = true;
         unsigned int amount = 10; // Number of blur passes
         for (unsigned int i = 0; i < amount; ++i) {
-            glBindFramebuffer(GL_FRAMEBUFFER, pingpongFBO[horizontal]);
+            GLState::instance().bindFramebuffer(pingpongFBO[horizontal]);
             blurShader->use();
-            blurShader->setBool("horizontal", horizontal);
-            blurShader->setInt("inputTexture", 0);
-            glActiveTexture(GL_TEXTURE0);
-            glBindTexture(GL_TEXTURE_2D, firstIteration ? pingpongColorbuffers[0] : pingpongColorbuffers[!horizontal]);
+            blurShader->set(horizontalUniform, horizontal);
+            blurShader->set(inputTextureUniform, 0);
+            GLState::instance().bindTexture(0, GL_TEXTURE_2D, firstIteration ? pingpongColorbuffers[0] : pingpongColorbuffers[!horizontal]);
             glClear(GL_COLOR_BUFFER_BIT);
             renderQuad();
             horizontal = !horizontal;
@@ -137,15 +143,13 @@ public:
         }
 
         // Combine pass
-        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        GLState::instance().bindFramebuffer(0);
         combineShader->use();
-        combineShader->setFloat("bloomStrength", bloomStrength);
-        combineShader->setInt("sceneTexture", 0);
-        combineShader->setInt("bloomTexture", 1);
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_2D, colorBuffer);
-        glActiveTexture(GL_TEXTURE1);
-        glBindTexture(GL_TEXTURE_2D, pingpongColorbuffers[!horizontal]);
+        combineShader->set(bloomStrengthUniform, bloomStrength);
+        combineShader->set(sceneTextureUniform, 0);
+        combineShader->set(bloomTextureUniform, 1);
+        GLState::instance().bindTexture(0, GL_TEXTURE_2D, colorBuffer);
+        GLState::instance().bindTexture(1, GL_TEXTURE_2D, pingpongColorbuffers[!horizontal]);
         renderQuad();
     }
 
@@ -160,7 +164,7 @@ public:
             };
             glGenVertexArrays(1, &quadVAO);
             glGenBuffers(1, &quadVBO);
-            glBindVertexArray(quadVAO);
+            GLState::instance().bindVertexArray(quadVAO);
             glBindBuffer(GL_ARRAY_BUFFER, quadVBO);
             glBufferData(GL_ARRAY_BUFFER, sizeof(quadVertices), &quadVertices, GL_STATIC_DRAW);
             glEnableVertexAttribArray(0);
@@ -168,13 +172,21 @@ public:
             glEnableVertexAttribArray(1);
             glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 5 * sizeof(float), (void*)(3 * sizeof(float)));
         }
-        glBindVertexArray(quadVAO);
+        GLState::instance().bindVertexArray(quadVAO);
         glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
-        glBindVertexArray(0);
     }
 
 
     ~PostProcess() {
+        GLState& state = GLState::instance();
+        state.forgetFramebuffer(hdrFBO);
+        state.forgetFramebuffer(pingpongFBO[0]);
+        state.forgetFramebuffer(pingpongFBO[1]);
+        state.forgetTexture(colorBuffer);
+        state.forgetTexture(brightBuffer);
+        state.forgetTexture(pingpongColorbuffers[0]);
+        state.forgetTexture(pingpongColorbuffers[1]);
+        state.forgetVertexArray(quadVAO);
         glDeleteFramebuffers(1, &hdrFBO);
         glDeleteTextures(1, &colorBuffer);
         glDeleteTextures(1, &brightBuffer);
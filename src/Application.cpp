@@ -9,12 +9,16 @@
 #include "Scene.h"
 #include "Player.h"
 #include "../PostProcess.h"
+#include "ObjParser.h"
+#include "PixelUploader.h"
 
 const float width = 800.0f;
 const float height = 600.0f;
 
 bool postProcessStoped;
 float deltaTime = 0.0f;
+// Milliseconds per frame spent uploading textures decoded in the background
+double textureUploadBudget = 2.0;
 std::shared_ptr <Camera> camera = std::make_shared<Camera>(glm::vec3(0.0f, 0.0f, 3.0f), glm::vec3(0.0f, 0.0f, -1.0f), glm::vec3(0.0f, 1.0f, 0.0f));
 Player player(camera);
 
@@ -35,8 +39,75 @@ void framebuffer_size_callback(GLFWwindow* window, int width, int height)
     glViewport(0, 0, width, height);
 }
 
-int main()
+int main(int argc, char** argv)
 {
+    // Offline benchmarks, run without opening a window
+    if (argc > 1 && std::string(argv[1]) == "--bench-obj")
+    {
+        ObjParser::benchmarkParsers(argc > 2 ? argv[2] : "Models/cottage_obj.obj");
+        return 0;
+    }
+    if (argc > 1 && std::string(argv[1]) == "--bench-bvh")
+    {
+        benchmarkBVH(argc > 2 ? std::stoul(argv[2]) : 10000);
+        return 0;
+    }
+    if (argc > 1 && std::string(argv[1]) == "--bench-sap")
+    {
+        benchmarkSweepAndPrune(argc > 2 ? std::stoul(argv[2]) : 10000);
+        return 0;
+    }
+
+    std::string sceneFile = "Data/Level0.scene";
+    for (int i = 1; i < argc; ++i)
+    {
+        std::string arg = argv[i];
+        if (arg == "--load-threads" && i + 1 < argc)
+            Mesh::loaderThreads = static_cast<unsigned>(std::stoul(argv[++i]));
+        else if (arg == "--no-mesh-cache")
+            Mesh::useMeshCache = false;
+        else if (arg == "--no-mesh-optimize")
+            Mesh::optimizeMeshes = false;
+        else if (arg == "--float-vertices")
+            Mesh::compactVertices = false;
+        else if (arg == "--sync-textures")
+            TextureManager::asyncLoading = false;
+        else if (arg == "--no-pbo")
+            PixelUploadRing::usePixelBuffers = false;
+        else if (arg == "--no-texture-compression")
+            TextureCache::compressTextures = false;
+        else if (arg == "--box-mips")
+            TextureCache::mipFilter = MipBuilder::BoxFilter;
+        else if (arg == "--no-texture-arrays")
+            TextureArrayPacker::enabled = false;
+        else if (arg == "--no-instancing")
+            Scene::useInstancing = false;
+        else if (arg == "--no-culling")
+            Scene::useFrustumCulling = false;
+        else if (arg == "--no-bvh")
+            Scene::useBVH = false;
+        else if (arg == "--no-collision-grid")
+            Scene::useCollisionGrid = false;
+        else if (arg == "--no-occlusion-culling")
+            Scene::useOcclusionCulling = false;
+        else if (arg == "--cull-stats")
+            Scene::printCullStats = true;
+        else if (arg == "--no-multi-draw")
+            MultiDrawIndirect::enabled = false;
+        else if (arg == "--scene" && i + 1 < argc)
+            sceneFile = argv[++i];
+        else if (arg == "--gl-stats")
+            GLState::printFrameStats = true;
+        else if (arg == "--texture-budget" && i + 1 < argc)
+            TextureStreamer::budgetBytes = static_cast<size_t>(std::stoul(argv[++i])) * 1024 * 1024;
+        else if (arg == "--texture-quality" && i + 1 < argc)
+        {
+            // Caps the top mip level: low 512, medium 1024, high full resolution
+            std::string tier = argv[++i];
+            TextureCache::maxTextureSize = tier == "low" ? 512 : tier == "medium" ? 1024 : 0;
+        }
+    }
+
     if (!initGLFW())
         return -1;
 
@@ -47,15 +118,30 @@ int main()
     if (!initGLAD())
         return -1;
 
+    // Needs the GL context, compares direct and PBO uploads of the skybox faces and parallax maps
+    if (argc > 1 && std::string(argv[1]) == "--bench-upload")
+    {
+        benchmarkPixelUploads({
+            "Data/Skybox/Box_Right.bmp", "Data/Skybox/Box_Left.bmp", "Data/Skybox/Box_Top.bmp",
+            "Data/Skybox/Box_Bottom.bmp", "Data/Skybox/Box_Front.bmp", "Data/Skybox/Box_Back.bmp",
+            "Data/paralax/brick_color.jpg", "Data/paralax/brick_normal.jpg", "Data/paralax/brick_height.png",
+            "Data/paralax/rock2_color.png", "Data/paralax/rock2_height.jpg" });
+        glfwTerminate();
+        return 0;
+    }
+
+    // Needs to be settled before the first mesh upload and the scene shaders
+    GeometryPool::enabled = MultiDrawIndirect::load(glfwGetProcAddress);
+
     glfwSetFramebufferSizeCallback(window, framebuffer_size_callback);
     glfwSetCursorPosCallback(window, mouse_callback);
     glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
 
-    glEnable(GL_DEPTH_TEST);
+    GLState::instance().setDepthTest(true);
     glm::mat4 projection = glm::perspective(glm::radians(45.0f), width / height, 0.1f, 100.0f);
 
     Scene scene(projection);
-    scene.loadFromFile("Data/Level0.scene");
+    scene.loadFromFile(sceneFile);
 
     std::shared_ptr<Shader> lightShader = std::make_shared<Shader>("src/Shaders/LightShader/VertexShader.vs",
         "src/Shaders/LightShader/FragmentShader.fs");
@@ -75,6 +161,9 @@ int main()
         deltaTime = calculateDeltatime();
         processInput_callback(window);
 
+        if (TextureLoader::instance().processUploads(textureUploadBudget) && TextureLoader::instance().idle())
+            TextureManager::instance().printStats();
+
         if (!camera->freeFlyMode)
             camera->position = player.playerModel.position + glm::vec3(0.0f, player.playerModel.scale.y+0.4f, 0.0f);
         glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
@@ -83,6 +172,7 @@ int main()
             postProcess.BeginRender();
 
         scene.update(deltaTime);
+        scene.streamTextures(*camera, height);
         scene.render(camera);
 
         player.applyPhysics(deltaTime, scene);
@@ -90,6 +180,7 @@ int main()
         if (postProcessStoped) 
             postProcess.ApplyBloom(0.90f, 0.001f);
 
+        GLState::instance().endFrame();
         glfwSwapBuffers(window);
         glfwPollEvents();
     }
@@ -0,0 +1,495 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <iostream>
+#include <limits>
+#include <random>
+#include <vector>
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+#include "Mesh.h"
+#include "Frustum.h"
+
+// 32 bytes, two per cache line. Nodes are stored depth first: the left child of an inner node
+// is the node right after it, so only the right child index is kept.
+struct BVHNode {
+    glm::vec3 min;
+    uint32_t rightOrFirst;  // inner nodes: right child, leaves: first entry of BVH::indices
+    glm::vec3 max;
+    uint32_t count;         // 0 for inner nodes
+};
+
+static_assert(sizeof(BVHNode) == 32, "BVHNode must stay 32 bytes");
+
+// Bounding volume hierarchy over a list of world space boxes, built with the binned surface
+// area heuristic. Queries report box indices. Moving boxes are handled by update(), which
+// refits the tree and rebuilds it when refitting has made it much worse than a new build.
+class BVH {
+public:
+    static constexpr uint32_t maxLeafSize = 4;
+    static constexpr int binCount = 16;
+    static constexpr int maxDepth = 48;
+    // Rebuild when the refitted tree's SAH cost exceeds the built one by this factor
+    static constexpr float rebuildRatio = 1.5f;
+
+    struct RayHit {
+        int index = -1;
+        float distance = std::numeric_limits<float>::max();
+    };
+
+    void build(const std::vector<AABB>& newBoxes) {
+        boxes = newBoxes;
+        nodes.clear();
+        indices.resize(boxes.size());
+        centroids.resize(boxes.size());
+        for (uint32_t i = 0; i < boxes.size(); ++i) {
+            indices[i] = i;
+            centroids[i] = (boxes[i].min + boxes[i].max) * 0.5f;
+        }
+        if (boxes.empty()) {
+            builtCost = 0.0f;
+            return;
+        }
+
+        nodes.reserve(boxes.size() * 2 / maxLeafSize + 1);
+        buildNode(0, static_cast<uint32_t>(boxes.size()), 0);
+        builtCost = cost();
+    }
+
+    // Boxes must be the same list in the same order as in build(), only moved. Returns true
+    // when the tree was rebuilt instead of refitted.
+    bool update(const std::vector<AABB>& movedBoxes) {
+        if (movedBoxes.size() != boxes.size()) {
+            build(movedBoxes);
+            return true;
+        }
+        boxes = movedBoxes;
+        refit();
+        if (cost() > builtCost * rebuildRatio) {
+            build(movedBoxes);
+            return true;
+        }
+        return false;
+    }
+
+    // Children come after their parent, so a reverse walk sees both children first
+    void refit() {
+        for (size_t i = nodes.size(); i-- > 0;) {
+            BVHNode& node = nodes[i];
+            if (node.count > 0) {
+                AABB bounds = boxes[indices[node.rightOrFirst]];
+                for (uint32_t j = 1; j < node.count; ++j) {
+                    grow(bounds, boxes[indices[node.rightOrFirst + j]]);
+                }
+                node.min = bounds.min;
+                node.max = bounds.max;
+            }
+            else {
+                const BVHNode& left = nodes[i + 1];
+                const BVHNode& right = nodes[node.rightOrFirst];
+                node.min = glm::min(left.min, right.min);
+                node.max = glm::max(left.max, right.max);
+            }
+        }
+    }
+
+    bool empty() const {
+        return nodes.empty();
+    }
+
+    size_t nodeCount() const {
+        return nodes.size();
+    }
+
+    // visit(index) for every box inside or crossing the frustum. Subtrees whose node is fully
+    // inside are reported without further plane tests.
+    template <typename Visit>
+    void queryFrustum(const Frustum& frustum, Visit&& visit) const {
+        if (nodes.empty()) {
+            return;
+        }
+        uint32_t stack[maxDepth + 2];
+        bool insideStack[maxDepth + 2];
+        int top = 0;
+        stack[top] = 0;
+        insideStack[top++] = false;
+
+        while (top > 0) {
+            --top;
+            uint32_t nodeIndex = stack[top];
+            bool inside = insideStack[top];
+            const BVHNode& node = nodes[nodeIndex];
+            if (!inside) {
+                Frustum::Containment containment = frustum.classify(bounds(node));
+                if (containment == Frustum::Outside) {
+                    continue;
+                }
+                inside = containment == Frustum::Inside;
+            }
+
+            if (node.count > 0) {
+                for (uint32_t j = 0; j < node.count; ++j) {
+                    uint32_t index = indices[node.rightOrFirst + j];
+                    if (inside || frustum.intersects(boxes[index])) {
+                        visit(index);
+                    }
+                }
+                continue;
+            }
+            stack[top] = node.rightOrFirst;
+            insideStack[top++] = inside;
+            stack[top] = nodeIndex + 1;
+            insideStack[top++] = inside;
+        }
+    }
+
+    // visit(index) for every box overlapping box, touching counts as overlapping
+    template <typename Visit>
+    void queryOverlap(const AABB& box, Visit&& visit) const {
+        if (nodes.empty()) {
+            return;
+        }
+        uint32_t stack[maxDepth + 2];
+        int top = 0;
+        stack[top++] = 0;
+
+        while (top > 0) {
+            uint32_t nodeIndex = stack[--top];
+            const BVHNode& node = nodes[nodeIndex];
+            if (!overlaps(bounds(node), box)) {
+                continue;
+            }
+            if (node.count > 0) {
+                for (uint32_t j = 0; j < node.count; ++j) {
+                    uint32_t index = indices[node.rightOrFirst + j];
+                    if (overlaps(boxes[index], box)) {
+                        visit(index);
+                    }
+                }
+                continue;
+            }
+            stack[top++] = node.rightOrFirst;
+            stack[top++] = nodeIndex + 1;
+        }
+    }
+
+    // Nearest box hit by the ray within maxDistance, direction does not need to be normalized
+    // but distances are in units of its length
+    RayHit raycast(const glm::vec3& origin, const glm::vec3& direction, float maxDistance = std::numeric_limits<float>::max()) const {
+        RayHit hit;
+        hit.distance = maxDistance;
+        if (nodes.empty()) {
+            return hit;
+        }
+        glm::vec3 inverse = 1.0f / direction;
+
+        uint32_t stack[maxDepth + 2];
+        int top = 0;
+        stack[top++] = 0;
+        while (top > 0) {
+            uint32_t nodeIndex = stack[--top];
+            const BVHNode& node = nodes[nodeIndex];
+            if (slab(bounds(node), origin, inverse) >= hit.distance) {
+                continue;
+            }
+            if (node.count > 0) {
+                for (uint32_t j = 0; j < node.count; ++j) {
+                    uint32_t index = indices[node.rightOrFirst + j];
+                    float distance = slab(boxes[index], origin, inverse);
+                    if (distance < hit.distance) {
+                        hit.distance = distance;
+                        hit.index = static_cast<int>(index);
+                    }
+                }
+                continue;
+            }
+
+            // Nearer child on top of the stack, its hits can prune the other one
+            uint32_t left = nodeIndex + 1, right = node.rightOrFirst;
+            float leftDistance = slab(bounds(nodes[left]), origin, inverse);
+            float rightDistance = slab(bounds(nodes[right]), origin, inverse);
+            if (leftDistance > rightDistance) {
+                std::swap(left, right);
+                std::swap(leftDistance, rightDistance);
+            }
+            if (rightDistance < hit.distance) {
+                stack[top++] = right;
+            }
+            if (leftDistance < hit.distance) {
+                stack[top++] = left;
+            }
+        }
+        return hit;
+    }
+
+    // Entry distance of the ray into box, infinity when it misses
+    static float slab(const AABB& box, const glm::vec3& origin, const glm::vec3& inverseDirection) {
+        glm::vec3 t0 = (box.min - origin) * inverseDirection;
+        glm::vec3 t1 = (box.max - origin) * inverseDirection;
+        glm::vec3 lower = glm::min(t0, t1);
+        glm::vec3 upper = glm::max(t0, t1);
+        float enter = std::max(std::max(lower.x, lower.y), std::max(lower.z, 0.0f));
+        float exit = std::min(std::min(upper.x, upper.y), upper.z);
+        return enter <= exit ? enter : std::numeric_limits<float>::infinity();
+    }
+
+    static bool overlaps(const AABB& a, const AABB& b) {
+        return a.min.x <= b.max.x && a.max.x >= b.min.x &&
+            a.min.y <= b.max.y && a.max.y >= b.min.y &&
+            a.min.z <= b.max.z && a.max.z >= b.min.z;
+    }
+
+private:
+    struct Bin {
+        AABB bounds;
+        uint32_t count = 0;
+    };
+
+    static AABB emptyBounds() {
+        return { glm::vec3(std::numeric_limits<float>::max()), glm::vec3(std::numeric_limits<float>::lowest()) };
+    }
+
+    static void grow(AABB& bounds, const AABB& box) {
+        bounds.min = glm::min(bounds.min, box.min);
+        bounds.max = glm::max(bounds.max, box.max);
+    }
+
+    static float area(const AABB& box) {
+        glm::vec3 extent = glm::max(box.max - box.min, glm::vec3(0.0f));
+        return 2.0f * (extent.x * extent.y + extent.y * extent.z + extent.z * extent.x);
+    }
+
+    static AABB bounds(const BVHNode& node) {
+        return { node.min, node.max };
+    }
+
+    uint32_t buildNode(uint32_t begin, uint32_t end, int depth) {
+        uint32_t nodeIndex = static_cast<uint32_t>(nodes.size());
+        nodes.emplace_back();
+
+        AABB nodeBounds = emptyBounds();
+        AABB centroidBounds = emptyBounds();
+        for (uint32_t i = begin; i < end; ++i) {
+            grow(nodeBounds, boxes[indices[i]]);
+            grow(centroidBounds, { centroids[indices[i]], centroids[indices[i]] });
+        }
+        nodes[nodeIndex].min = nodeBounds.min;
+        nodes[nodeIndex].max = nodeBounds.max;
+
+        uint32_t count = end - begin;
+        uint32_t middle = count > maxLeafSize && depth < maxDepth ? split(begin, end, nodeBounds, centroidBounds) : begin;
+        if (middle == begin || middle == end) {
+            nodes[nodeIndex].rightOrFirst = begin;
+            nodes[nodeIndex].count = count;
+            return nodeIndex;
+        }
+
+        buildNode(begin, middle, depth + 1);
+        uint32_t right = buildNode(middle, end, depth + 1);
+        nodes[nodeIndex].rightOrFirst = right;
+        nodes[nodeIndex].count = 0;
+        return nodeIndex;
+    }
+
+    // Partitions indices[begin, end) at the cheapest of the bin boundaries on all three axes
+    // and returns the split point, or begin when a leaf is cheaper
+    uint32_t split(uint32_t begin, uint32_t end, const AABB& nodeBounds, const AABB& centroidBounds) {
+        glm::vec3 extent = centroidBounds.max - centroidBounds.min;
+        float bestCost = std::numeric_limits<float>::max();
+        int bestAxis = -1, bestBin = 0;
+
+        for (int axis = 0; axis < 3; ++axis) {
+            if (extent[axis] <= 0.0f) {
+                continue;
+            }
+            Bin bins[binCount];
+            for (Bin& bin : bins) {
+                bin.bounds = emptyBounds();
+            }
+            float scale = binCount / extent[axis];
+            for (uint32_t i = begin; i < end; ++i) {
+                int b = std::min(binCount - 1, static_cast<int>((centroids[indices[i]][axis] - centroidBounds.min[axis]) * scale));
+                grow(bins[b].bounds, boxes[indices[i]]);
+                ++bins[b].count;
+            }
+
+            // Left sweep stores area * count up to each boundary, the right sweep adds its side
+            float leftCost[binCount - 1];
+            uint32_t leftCounts[binCount - 1];
+            AABB left = emptyBounds();
+            uint32_t leftCount = 0;
+            for (int b = 0; b < binCount - 1; ++b) {
+                grow(left, bins[b].bounds);
+                leftCount += bins[b].count;
+                leftCounts[b] = leftCount;
+                leftCost[b] = leftCount ? area(left) * leftCount : 0.0f;
+            }
+            AABB right = emptyBounds();
+            uint32_t rightCount = 0;
+            for (int b = binCount - 1; b > 0; --b) {
+                grow(right, bins[b].bounds);
+                rightCount += bins[b].count;
+                if (leftCounts[b - 1] == 0 || rightCount == 0) {
+                    continue;
+                }
+                float splitCost = leftCost[b - 1] + area(right) * rightCount;
+                if (splitCost < bestCost) {
+                    bestCost = splitCost;
+                    bestAxis = axis;
+                    bestBin = b;
+                }
+            }
+        }
+
+        // Everything sits on one centroid, split in the middle so leaves stay small
+        if (bestAxis < 0) {
+            return begin + (end - begin) / 2;
+        }
+        // A split also pays for visiting the inner node
+        float leafCost = area(nodeBounds) * (end - begin);
+        if (end - begin <= maxLeafSize * 4 && bestCost + area(nodeBounds) >= leafCost) {
+            return begin;
+        }
+
+        float scale = binCount / extent[bestAxis];
+        float minimum = centroidBounds.min[bestAxis];
+        uint32_t* middle = std::partition(indices.data() + begin, indices.data() + end, [&](uint32_t index) {
+            return std::min(binCount - 1, static_cast<int>((centroids[index][bestAxis] - minimum) * scale)) < bestBin;
+        });
+        return static_cast<uint32_t>(middle - indices.data());
+    }
+
+    // SAH cost relative to the root, inner node traversal and box tests weighted the same
+    float cost() const {
+        if (nodes.empty()) {
+            return 0.0f;
+        }
+        float total = 0.0f;
+        for (const BVHNode& node : nodes) {
+            total += area(bounds(node)) * (node.count > 0 ? node.count : 1);
+        }
+        return total / std::max(area(bounds(nodes[0])), std::numeric_limits<float>::min());
+    }
+
+    std::vector<BVHNode> nodes;
+    std::vector<uint32_t> indices;
+    std::vector<AABB> boxes;
+    std::vector<glm::vec3> centroids;
+    float builtCost = 0.0f;
+};
+
+// Compares the BVH with the linear loops it replaces on random boxes, run with --bench-bvh
+inline void benchmarkBVH(size_t count = 10000, int queries = 1000) {
+    std::mt19937 random(1234);
+    float world = std::cbrt(static_cast<float>(count)) * 4.0f;
+    std::uniform_real_distribution<float> position(-world, world);
+    std::uniform_real_distribution<float> size(0.2f, 2.0f);
+    std::uniform_real_distribution<float> unit(-1.0f, 1.0f);
+
+    std::vector<AABB> boxes(count);
+    for (AABB& box : boxes) {
+        glm::vec3 center(position(random), position(random), position(random));
+        glm::vec3 half(size(random), size(random), size(random));
+        box = { center - half, center + half };
+    }
+
+    using Clock = std::chrono::high_resolution_clock;
+    auto milliseconds = [](Clock::time_point start) {
+        return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+    };
+
+    std::cout << "BVH benchmark: " << count << " boxes, " << queries << " queries per test" << std::endl;
+
+    BVH bvh;
+    auto start = Clock::now();
+    bvh.build(boxes);
+    std::cout << "  build " << milliseconds(start) << " ms, " << bvh.nodeCount() << " nodes" << std::endl;
+
+    std::vector<AABB> moved = boxes;
+    for (AABB& box : moved) {
+        glm::vec3 offset(unit(random) * 0.5f, unit(random) * 0.5f, unit(random) * 0.5f);
+        box = { box.min + offset, box.max + offset };
+    }
+    start = Clock::now();
+    bool rebuilt = bvh.update(moved);
+    std::cout << "  update after small moves " << milliseconds(start) << " ms (" << (rebuilt ? "rebuilt" : "refitted") << ")" << std::endl;
+    bvh.build(boxes);
+
+    // Frustum culling, camera inside the box cloud looking along random directions
+    glm::mat4 projection = glm::perspective(glm::radians(45.0f), 4.0f / 3.0f, 0.1f, world);
+    std::vector<Frustum> frustums;
+    for (int i = 0; i < queries; ++i) {
+        glm::vec3 eye(position(random), position(random), position(random));
+        glm::vec3 direction = glm::normalize(glm::vec3(unit(random), unit(random) * 0.3f, unit(random)) + glm::vec3(0.001f));
+        frustums.push_back(Frustum::fromMatrix(projection * glm::lookAt(eye, eye + direction, glm::vec3(0.0f, 1.0f, 0.0f))));
+    }
+    BoundsArray bounds;
+    bounds.resize(count);
+    for (size_t i = 0; i < count; ++i) {
+        bounds.set(i, boxes[i]);
+    }
+    std::vector<uint8_t> visible;
+    size_t linearVisible = 0, treeVisible = 0;
+    start = Clock::now();
+    for (const Frustum& frustum : frustums) {
+        linearVisible += frustum.cull(bounds, visible);
+    }
+    double linear = milliseconds(start);
+    start = Clock::now();
+    for (const Frustum& frustum : frustums) {
+        bvh.queryFrustum(frustum, [&](uint32_t) { ++treeVisible; });
+    }
+    double tree = milliseconds(start);
+    std::cout << "  frustum: linear SIMD " << linear / queries << " ms, BVH " << tree / queries << " ms per query, "
+        << linearVisible / queries << " visible on average" << (linearVisible == treeVisible ? "" : " (RESULTS DIFFER)") << std::endl;
+
+    // Overlap with player sized boxes
+    std::vector<AABB> probes;
+    for (int i = 0; i < queries; ++i) {
+        glm::vec3 center(position(random), position(random), position(random));
+        probes.push_back({ center - glm::vec3(0.2f, 0.7f, 0.2f), center + glm::vec3(0.2f, 0.7f, 0.2f) });
+    }
+    size_t linearOverlaps = 0, treeOverlaps = 0;
+    start = Clock::now();
+    for (const AABB& probe : probes) {
+        for (const AABB& box : boxes) {
+            linearOverlaps += BVH::overlaps(box, probe);
+        }
+    }
+    linear = milliseconds(start);
+    start = Clock::now();
+    for (const AABB& probe : probes) {
+        bvh.queryOverlap(probe, [&](uint32_t) { ++treeOverlaps; });
+    }
+    tree = milliseconds(start);
+    std::cout << "  overlap: linear " << linear / queries * 1000.0 << " us, BVH " << tree / queries * 1000.0 << " us per query"
+        << (linearOverlaps == treeOverlaps ? "" : " (RESULTS DIFFER)") << std::endl;
+
+    // Nearest hit along random rays
+    size_t mismatches = 0;
+    double linearRays = 0.0, treeRays = 0.0;
+    for (int i = 0; i < queries; ++i) {
+        glm::vec3 origin(position(random), position(random), position(random));
+        glm::vec3 direction = glm::normalize(glm::vec3(unit(random), unit(random), unit(random)) + glm::vec3(0.001f));
+        glm::vec3 inverse = 1.0f / direction;
+
+        start = Clock::now();
+        float nearest = std::numeric_limits<float>::max();
+        for (const AABB& box : boxes) {
+            nearest = std::min(nearest, BVH::slab(box, origin, inverse));
+        }
+        linearRays += milliseconds(start);
+
+        start = Clock::now();
+        BVH::RayHit hit = bvh.raycast(origin, direction);
+        treeRays += milliseconds(start);
+        if (hit.distance != nearest) {
+            ++mismatches;
+        }
+    }
+    std::cout << "  ray: linear " << linearRays / queries * 1000.0 << " us, BVH " << treeRays / queries * 1000.0 << " us per query"
+        << (mismatches ? " (RESULTS DIFFER)" : "") << std::endl;
+}
@@ -0,0 +1,247 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <vector>
+
+// CPU encoders for the BCn block formats. Every format works on 4x4 pixel blocks:
+//   BC1  RGB, 8 bytes per block    (color textures without alpha)
+//   BC3  RGBA, 16 bytes per block  (BC4 alpha followed by a BC1 color block)
+//   BC4  R, 8 bytes per block      (height maps)
+//   BC5  RG, 16 bytes per block    (normal maps, z is rebuilt in the shader)
+namespace BlockCompression {
+
+    enum Format {
+        BC1 = 0,
+        BC3 = 1,
+        BC4 = 2,
+        BC5 = 3
+    };
+
+    inline size_t blockBytes(Format format) {
+        return (format == BC1 || format == BC4) ? 8 : 16;
+    }
+
+    inline size_t levelSize(Format format, int width, int height) {
+        return static_cast<size_t>((width + 3) / 4) * ((height + 3) / 4) * blockBytes(format);
+    }
+
+    inline uint16_t packRGB565(const float color[3]) {
+        int r = std::clamp(static_cast<int>(color[0] * 31.0f / 255.0f + 0.5f), 0, 31);
+        int g = std::clamp(static_cast<int>(color[1] * 63.0f / 255.0f + 0.5f), 0, 63);
+        int b = std::clamp(static_cast<int>(color[2] * 31.0f / 255.0f + 0.5f), 0, 31);
+        return static_cast<uint16_t>((r << 11) | (g << 5) | b);
+    }
+
+    inline void unpackRGB565(uint16_t packed, float color[3]) {
+        int r = (packed >> 11) & 31, g = (packed >> 5) & 63, b = packed & 31;
+        color[0] = static_cast<float>((r << 3) | (r >> 2));
+        color[1] = static_cast<float>((g << 2) | (g >> 4));
+        color[2] = static_cast<float>((b << 3) | (b >> 2));
+    }
+
+    // Picks the nearest of the four palette entries per pixel, returns the packed indices and the squared error
+    inline uint32_t selectBC1Indices(const float pixels[16][3], uint16_t color0, uint16_t color1, float& error) {
+        float palette[4][3];
+        unpackRGB565(color0, palette[0]);
+        unpackRGB565(color1, palette[1]);
+        for (int c = 0; c < 3; ++c) {
+            palette[2][c] = (2.0f * palette[0][c] + palette[1][c]) / 3.0f;
+            palette[3][c] = (palette[0][c] + 2.0f * palette[1][c]) / 3.0f;
+        }
+
+        uint32_t indices = 0;
+        error = 0.0f;
+        for (int i = 0; i < 16; ++i) {
+            int best = 0;
+            float bestDistance = std::numeric_limits<float>::max();
+            for (int p = 0; p < 4; ++p) {
+                float dr = pixels[i][0] - palette[p][0], dg = pixels[i][1] - palette[p][1], db = pixels[i][2] - palette[p][2];
+                float distance = dr * dr + dg * dg + db * db;
+                if (distance < bestDistance) {
+                    bestDistance = distance;
+                    best = p;
+                }
+            }
+            indices |= static_cast<uint32_t>(best) << (2 * i);
+            error += bestDistance;
+        }
+        return indices;
+    }
+
+    inline void writeBC1(uint16_t color0, uint16_t color1, uint32_t indices, uint8_t* out) {
+        out[0] = static_cast<uint8_t>(color0);
+        out[1] = static_cast<uint8_t>(color0 >> 8);
+        out[2] = static_cast<uint8_t>(color1);
+        out[3] = static_cast<uint8_t>(color1 >> 8);
+        std::memcpy(out + 4, &indices, 4);
+    }
+
+    // Endpoints along the principal axis of the block colors, then one least squares refit
+    inline void encodeBC1Block(const float pixels[16][3], uint8_t* out) {
+        float mean[3] = { 0.0f, 0.0f, 0.0f };
+        for (int i = 0; i < 16; ++i) {
+            for (int c = 0; c < 3; ++c) {
+                mean[c] += pixels[i][c] / 16.0f;
+            }
+        }
+
+        float covariance[6] = {};
+        for (int i = 0; i < 16; ++i) {
+            float r = pixels[i][0] - mean[0], g = pixels[i][1] - mean[1], b = pixels[i][2] - mean[2];
+            covariance[0] += r * r; covariance[1] += r * g; covariance[2] += r * b;
+            covariance[3] += g * g; covariance[4] += g * b; covariance[5] += b * b;
+        }
+
+        float axis[3] = { 1.0f, 1.0f, 1.0f };
+        for (int iteration = 0; iteration < 8; ++iteration) {
+            float x = covariance[0] * axis[0] + covariance[1] * axis[1] + covariance[2] * axis[2];
+            float y = covariance[1] * axis[0] + covariance[3] * axis[1] + covariance[4] * axis[2];
+            float z = covariance[2] * axis[0] + covariance[4] * axis[1] + covariance[5] * axis[2];
+            float length = std::max({ std::fabs(x), std::fabs(y), std::fabs(z) });
+            if (length < 1e-6f) {
+                break;
+            }
+            axis[0] = x / length; axis[1] = y / length; axis[2] = z / length;
+        }
+
+        float minProjection = std::numeric_limits<float>::max(), maxProjection = std::numeric_limits<float>::lowest();
+        for (int i = 0; i < 16; ++i) {
+            float projection = (pixels[i][0] - mean[0]) * axis[0] + (pixels[i][1] - mean[1]) * axis[1] + (pixels[i][2] - mean[2]) * axis[2];
+            minProjection = std::min(minProjection, projection);
+            maxProjection = std::max(maxProjection, projection);
+        }
+
+        // Inset by 1/16 of the range, the extremes are rarely hit exactly after 565 rounding
+        float inset = (maxProjection - minProjection) / 16.0f;
+        float high[3], low[3];
+        for (int c = 0; c < 3; ++c) {
+            high[c] = std::clamp(mean[c] + axis[c] * (maxProjection - inset), 0.0f, 255.0f);
+            low[c] = std::clamp(mean[c] + axis[c] * (minProjection + inset), 0.0f, 255.0f);
+        }
+
+        uint16_t color0 = packRGB565(high), color1 = packRGB565(low);
+        if (color0 < color1) {
+            std::swap(color0, color1);
+        }
+        if (color0 == color1) {
+            writeBC1(color0, color1, 0, out);
+            return;
+        }
+
+        float error;
+        uint32_t indices = selectBC1Indices(pixels, color0, color1, error);
+
+        // Solve for the endpoints that best reproduce the pixels with the chosen weights
+        static const float weights[4] = { 1.0f, 0.0f, 2.0f / 3.0f, 1.0f / 3.0f };
+        float aa = 0.0f, ab = 0.0f, bb = 0.0f, ax[3] = {}, bx[3] = {};
+        for (int i = 0; i < 16; ++i) {
+            float a = weights[(indices >> (2 * i)) & 3], b = 1.0f - a;
+            aa += a * a; ab += a * b; bb += b * b;
+            for (int c = 0; c < 3; ++c) {
+                ax[c] += a * pixels[i][c];
+                bx[c] += b * pixels[i][c];
+            }
+        }
+        float determinant = aa * bb - ab * ab;
+        if (std::fabs(determinant) > 1e-6f) {
+            for (int c = 0; c < 3; ++c) {
+                high[c] = std::clamp((ax[c] * bb - bx[c] * ab) / determinant, 0.0f, 255.0f);
+                low[c] = std::clamp((bx[c] * aa - ax[c] * ab) / determinant, 0.0f, 255.0f);
+            }
+            uint16_t refined0 = packRGB565(high), refined1 = packRGB565(low);
+            if (refined0 < refined1) {
+                std::swap(refined0, refined1);
+            }
+            if (refined0 != refined1) {
+                float refinedError;
+                uint32_t refinedIndices = selectBC1Indices(pixels, refined0, refined1, refinedError);
+                if (refinedError < error) {
+                    color0 = refined0;
+                    color1 = refined1;
+                    indices = refinedIndices;
+                }
+            }
+        }
+
+        writeBC1(color0, color1, indices, out);
+    }
+
+    // Eight value mode: endpoints are the block min and max, six values interpolated between them
+    inline void encodeBC4Block(const uint8_t values[16], uint8_t* out) {
+        uint8_t high = *std::max_element(values, values + 16);
+        uint8_t low = *std::min_element(values, values + 16);
+        out[0] = high;
+        out[1] = low;
+
+        uint64_t indices = 0;
+        if (high != low) {
+            float palette[8];
+            palette[0] = high;
+            palette[1] = low;
+            for (int i = 1; i < 7; ++i) {
+                palette[i + 1] = ((7 - i) * static_cast<float>(high) + i * static_cast<float>(low)) / 7.0f;
+            }
+            for (int i = 0; i < 16; ++i) {
+                int best = 0;
+                float bestDistance = std::numeric_limits<float>::max();
+                for (int p = 0; p < 8; ++p) {
+                    float distance = std::fabs(values[i] - palette[p]);
+                    if (distance < bestDistance) {
+                        bestDistance = distance;
+                        best = p;
+                    }
+                }
+                indices |= static_cast<uint64_t>(best) << (3 * i);
+            }
+        }
+        for (int i = 0; i < 6; ++i) {
+            out[2 + i] = static_cast<uint8_t>(indices >> (8 * i));
+        }
+    }
+
+    // Compresses one image level with 3 or 4 channels, edge blocks repeat the last row/column
+    inline std::vector<uint8_t> compress(Format format, const uint8_t* pixels, int width, int height, int channels) {
+        std::vector<uint8_t> output(levelSize(format, width, height));
+        uint8_t* out = output.data();
+
+        for (int by = 0; by < height; by += 4) {
+            for (int bx = 0; bx < width; bx += 4) {
+                float color[16][3];
+                uint8_t first[16], second[16];
+                for (int i = 0; i < 16; ++i) {
+                    int x = std::min(bx + (i & 3), width - 1);
+                    int y = std::min(by + (i >> 2), height - 1);
+                    const uint8_t* pixel = pixels + (static_cast<size_t>(y) * width + x) * channels;
+                    for (int c = 0; c < 3; ++c) {
+                        color[i][c] = pixel[c];
+                    }
+                    first[i] = format == BC3 ? (channels == 4 ? pixel[3] : 255) : pixel[0];
+                    second[i] = pixel[1];
+                }
+
+                switch (format) {
+                case BC1:
+                    encodeBC1Block(color, out);
+                    break;
+                case BC3:
+                    encodeBC4Block(first, out);
+                    encodeBC1Block(color, out + 8);
+                    break;
+                case BC4:
+                    encodeBC4Block(first, out);
+                    break;
+                case BC5:
+                    encodeBC4Block(first, out);
+                    encodeBC4Block(second, out + 8);
+                    break;
+                }
+                out += blockBytes(format);
+            }
+        }
+        return output;
+    }
+}
@@ -1,7 +1,15 @@
 #pragma once
+#include <cstddef>
 #include <glm/ext/vector_float3.hpp>
 
 struct CollisionResult {
     bool collided;
     glm::vec3 collisionNormal; // Kierunek kolizji
 };
+
+// Two moving bodies in contact, indices into the list passed to Scene::checkBodyCollisions
+struct BodyCollision {
+    size_t first;
+    size_t second;
+    glm::vec3 collisionNormal; // From second towards first
+};
@@ -0,0 +1,31 @@
+#pragma once
+
+#include <memory>
+#include <string>
+#include "stb_image.h"
+
+// Pixels decoded by stb_image, always RGB or RGBA. Safe to produce on any thread.
+struct DecodedImage {
+    std::unique_ptr<unsigned char, void(*)(void*)> pixels{ nullptr, stbi_image_free };
+    int width = 0, height = 0, nrChannels = 0;
+
+    explicit operator bool() const {
+        return pixels != nullptr;
+    }
+
+    static DecodedImage decode(const std::string& path, bool flip) {
+        DecodedImage image;
+        int channels = 0;
+        if (!stbi_info(path.c_str(), &image.width, &image.height, &channels)) {
+            return image;
+        }
+        // Grey and grey+alpha are expanded so the upload only deals with RGB and RGBA
+        int wanted = (channels == 2 || channels == 4) ? 4 : 3;
+
+        stbi_set_flip_vertically_on_load_thread(flip);
+        image.pixels.reset(stbi_load(path.c_str(), &image.width, &image.height, &channels, wanted));
+        stbi_set_flip_vertically_on_load_thread(false);
+        image.nrChannels = wanted;
+        return image;
+    }
+};
@@ -0,0 +1,164 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include <glm/glm.hpp>
+#include "Mesh.h"
+
+#if defined(__AVX__)
+#include <immintrin.h>
+#define FRUSTUM_AVX 1
+#endif
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#include <xmmintrin.h>
+#define FRUSTUM_SSE 1
+#endif
+
+// World bounds of many boxes as one array per component, padded to a multiple of 8 so the
+// SIMD tests always load whole registers
+struct BoundsArray {
+    std::vector<float> minX, minY, minZ, maxX, maxY, maxZ;
+    size_t count = 0;
+
+    void resize(size_t boxes) {
+        count = boxes;
+        size_t padded = (boxes + 7) & ~size_t(7);
+        for (std::vector<float>* component : { &minX, &minY, &minZ, &maxX, &maxY, &maxZ }) {
+            component->resize(padded, 0.0f);
+        }
+    }
+
+    void set(size_t i, const AABB& box) {
+        minX[i] = box.min.x;
+        minY[i] = box.min.y;
+        minZ[i] = box.min.z;
+        maxX[i] = box.max.x;
+        maxY[i] = box.max.y;
+        maxZ[i] = box.max.z;
+    }
+};
+
+// Six planes of a view-projection matrix with normals pointing inside. A box is culled when
+// its corner furthest along a plane's normal is behind that plane, boxes that only cross a
+// corner of the frustum outside every single plane are kept, which is conservative.
+class Frustum {
+public:
+    glm::vec4 planes[6];
+
+    // Gribb-Hartmann: every plane is the last row of the matrix plus or minus another row
+    static Frustum fromMatrix(const glm::mat4& viewProjection) {
+        glm::vec4 rows[4];
+        for (int i = 0; i < 4; ++i) {
+            rows[i] = glm::vec4(viewProjection[0][i], viewProjection[1][i], viewProjection[2][i], viewProjection[3][i]);
+        }
+
+        Frustum frustum;
+        for (int axis = 0; axis < 3; ++axis) {
+            frustum.planes[axis * 2] = rows[3] + rows[axis];
+            frustum.planes[axis * 2 + 1] = rows[3] - rows[axis];
+        }
+        for (glm::vec4& plane : frustum.planes) {
+            plane /= glm::length(glm::vec3(plane));
+        }
+        return frustum;
+    }
+
+    bool intersects(const AABB& box) const {
+        for (const glm::vec4& plane : planes) {
+            glm::vec3 corner(plane.x >= 0.0f ? box.max.x : box.min.x,
+                             plane.y >= 0.0f ? box.max.y : box.min.y,
+                             plane.z >= 0.0f ? box.max.z : box.min.z);
+            if (glm::dot(glm::vec3(plane), corner) + plane.w < 0.0f) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    enum Containment {
+        Outside = 0,
+        Intersecting,
+        Inside
+    };
+
+    // Inside when the nearest corner is in front of every plane, for hierarchies that can then
+    // skip the tests below a node
+    Containment classify(const AABB& box) const {
+        Containment result = Inside;
+        for (const glm::vec4& plane : planes) {
+            glm::vec3 normal(plane);
+            glm::vec3 outer(plane.x >= 0.0f ? box.max.x : box.min.x,
+                            plane.y >= 0.0f ? box.max.y : box.min.y,
+                            plane.z >= 0.0f ? box.max.z : box.min.z);
+            if (glm::dot(normal, outer) + plane.w < 0.0f) {
+                return Outside;
+            }
+            glm::vec3 inner(plane.x >= 0.0f ? box.min.x : box.max.x,
+                            plane.y >= 0.0f ? box.min.y : box.max.y,
+                            plane.z >= 0.0f ? box.min.z : box.max.z);
+            if (glm::dot(normal, inner) + plane.w < 0.0f) {
+                result = Intersecting;
+            }
+        }
+        return result;
+    }
+
+    // visible[i] becomes 1 for boxes inside or crossing the frustum, returns how many are.
+    // Eight boxes per step with AVX, four with SSE. The corner is picked once per plane for
+    // the whole batch by choosing the min or max array from the sign of the normal.
+    size_t cull(const BoundsArray& bounds, std::vector<uint8_t>& visible) const {
+        visible.resize(bounds.count);
+        size_t count = 0;
+        size_t i = 0;
+
+#if defined(FRUSTUM_AVX)
+        for (; i + 8 <= bounds.minX.size() && i < bounds.count; i += 8) {
+            __m256 outside = _mm256_setzero_ps();
+            for (const glm::vec4& plane : planes) {
+                __m256 x = _mm256_loadu_ps((plane.x >= 0.0f ? bounds.maxX : bounds.minX).data() + i);
+                __m256 y = _mm256_loadu_ps((plane.y >= 0.0f ? bounds.maxY : bounds.minY).data() + i);
+                __m256 z = _mm256_loadu_ps((plane.z >= 0.0f ? bounds.maxZ : bounds.minZ).data() + i);
+                __m256 distance = _mm256_add_ps(
+                    _mm256_add_ps(_mm256_mul_ps(x, _mm256_set1_ps(plane.x)), _mm256_mul_ps(y, _mm256_set1_ps(plane.y))),
+                    _mm256_add_ps(_mm256_mul_ps(z, _mm256_set1_ps(plane.z)), _mm256_set1_ps(plane.w)));
+                outside = _mm256_or_ps(outside, _mm256_cmp_ps(distance, _mm256_setzero_ps(), _CMP_LT_OQ));
+            }
+            count += store(visible, i, bounds.count, _mm256_movemask_ps(outside), 8);
+        }
+#elif defined(FRUSTUM_SSE)
+        for (; i + 4 <= bounds.minX.size() && i < bounds.count; i += 4) {
+            __m128 outside = _mm_setzero_ps();
+            for (const glm::vec4& plane : planes) {
+                __m128 x = _mm_loadu_ps((plane.x >= 0.0f ? bounds.maxX : bounds.minX).data() + i);
+                __m128 y = _mm_loadu_ps((plane.y >= 0.0f ? bounds.maxY : bounds.minY).data() + i);
+                __m128 z = _mm_loadu_ps((plane.z >= 0.0f ? bounds.maxZ : bounds.minZ).data() + i);
+                __m128 distance = _mm_add_ps(
+                    _mm_add_ps(_mm_mul_ps(x, _mm_set1_ps(plane.x)), _mm_mul_ps(y, _mm_set1_ps(plane.y))),
+                    _mm_add_ps(_mm_mul_ps(z, _mm_set1_ps(plane.z)), _mm_set1_ps(plane.w)));
+                outside = _mm_or_ps(outside, _mm_cmplt_ps(distance, _mm_setzero_ps()));
+            }
+            count += store(visible, i, bounds.count, _mm_movemask_ps(outside), 4);
+        }
+#endif
+
+        for (; i < bounds.count; ++i) {
+            AABB box = { glm::vec3(bounds.minX[i], bounds.minY[i], bounds.minZ[i]),
+                         glm::vec3(bounds.maxX[i], bounds.maxY[i], bounds.maxZ[i]) };
+            visible[i] = intersects(box) ? 1 : 0;
+            count += visible[i];
+        }
+        return count;
+    }
+
+private:
+    // Writes the lanes of an outside mask that are real boxes, not padding
+    static size_t store(std::vector<uint8_t>& visible, size_t first, size_t count, int outsideMask, int lanes) {
+        size_t inside = 0;
+        for (int lane = 0; lane < lanes && first + lane < count; ++lane) {
+            visible[first + lane] = (outsideMask >> lane) & 1 ? 0 : 1;
+            inside += visible[first + lane];
+        }
+        return inside;
+    }
+};
@@ -0,0 +1,244 @@
+#pragma once
+
+#include <glad/gl.h>
+#include <chrono>
+#include <cstddef>
+#include <iostream>
+
+// Shadows the GL bindings and render state the renderer touches and skips calls that would not
+// change anything. Code that binds these objects must go through here, and objects must be
+// forgotten when they are deleted, otherwise a recycled name could be skipped as already bound.
+class GLState {
+public:
+    // Prints the per frame counters about once a second
+    static inline bool printFrameStats = false;
+
+    enum Category {
+        ProgramCalls = 0,
+        VertexArrayCalls,
+        TextureCalls,
+        DepthBlendCalls,
+        FramebufferCalls,
+        CategoryCount
+    };
+
+    struct FrameStats {
+        size_t issued[CategoryCount] = {};
+        size_t elided[CategoryCount] = {};
+        size_t drawCalls = 0;
+        size_t instances = 0;
+    };
+
+    static GLState& instance() {
+        static GLState state;
+        return state;
+    }
+
+    void useProgram(GLuint program) {
+        if (track(ProgramCalls, currentProgram == program)) {
+            currentProgram = program;
+            glUseProgram(program);
+        }
+    }
+
+    void bindVertexArray(GLuint vertexArray) {
+        if (track(VertexArrayCalls, currentVertexArray == vertexArray)) {
+            currentVertexArray = vertexArray;
+            glBindVertexArray(vertexArray);
+        }
+    }
+
+    void activeTexture(unsigned unit) {
+        if (track(TextureCalls, activeUnit == unit)) {
+            activeUnit = unit;
+            glActiveTexture(GL_TEXTURE0 + unit);
+        }
+    }
+
+    void bindTexture(unsigned unit, GLenum target, GLuint texture) {
+        int index = targetIndex(target);
+        if (unit >= maxUnits || index < 0) {
+            activeTexture(unit);
+            glBindTexture(target, texture);
+            return;
+        }
+        if (track(TextureCalls, textures[unit][index] == texture)) {
+            activeTexture(unit);
+            textures[unit][index] = texture;
+            glBindTexture(target, texture);
+        }
+    }
+
+    // Binds on unit 0 and makes it active, for glTexImage and glTexParameter calls that follow.
+    // A skipped bindTexture() leaves the active unit alone, which is only fine for drawing.
+    void bindTextureForUpdate(GLenum target, GLuint texture) {
+        bindTexture(0, target, texture);
+        activeTexture(0);
+    }
+
+    void setDepthTest(bool enabled) {
+        setCapability(GL_DEPTH_TEST, depthTest, enabled);
+    }
+
+    void setBlend(bool enabled) {
+        setCapability(GL_BLEND, blend, enabled);
+    }
+
+    void setDepthFunc(GLenum func) {
+        if (track(DepthBlendCalls, depthFunc == func)) {
+            depthFunc = func;
+            glDepthFunc(func);
+        }
+    }
+
+    void setDepthMask(bool write) {
+        int value = write ? 1 : 0;
+        if (track(DepthBlendCalls, depthMask == value)) {
+            depthMask = value;
+            glDepthMask(write ? GL_TRUE : GL_FALSE);
+        }
+    }
+
+    void setBlendFunc(GLenum source, GLenum destination) {
+        if (track(DepthBlendCalls, blendSource == source && blendDestination == destination)) {
+            blendSource = source;
+            blendDestination = destination;
+            glBlendFunc(source, destination);
+        }
+    }
+
+    void bindFramebuffer(GLuint framebuffer) {
+        if (track(FramebufferCalls, currentFramebuffer == framebuffer)) {
+            currentFramebuffer = framebuffer;
+            glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+        }
+    }
+
+    // Called by the draw paths so the frame stats can show how many draws the batching saves
+    void countDraw(size_t instanceCount = 1) {
+        ++current.drawCalls;
+        current.instances += instanceCount;
+    }
+
+    // Call before deleting, GL unbinds deleted objects and may hand the name out again
+    void forgetProgram(GLuint program) {
+        if (currentProgram == program) {
+            currentProgram = unknown;
+        }
+    }
+
+    void forgetVertexArray(GLuint vertexArray) {
+        if (currentVertexArray == vertexArray) {
+            currentVertexArray = unknown;
+        }
+    }
+
+    void forgetTexture(GLuint texture) {
+        for (auto& unit : textures) {
+            for (GLuint& bound : unit) {
+                if (bound == texture) {
+                    bound = unknown;
+                }
+            }
+        }
+    }
+
+    void forgetFramebuffer(GLuint framebuffer) {
+        if (currentFramebuffer == framebuffer) {
+            currentFramebuffer = unknown;
+        }
+    }
+
+    // After code that changes state behind the tracker's back
+    void invalidate() {
+        currentProgram = currentVertexArray = currentFramebuffer = unknown;
+        activeUnit = unknown;
+        for (auto& unit : textures) {
+            for (GLuint& bound : unit) {
+                bound = unknown;
+            }
+        }
+        depthTest = blend = depthMask = -1;
+        depthFunc = blendSource = blendDestination = unknown;
+    }
+
+    void endFrame() {
+        last = current;
+        current = FrameStats();
+
+        auto now = std::chrono::steady_clock::now();
+        if (printFrameStats && now - lastPrint >= std::chrono::seconds(1)) {
+            lastPrint = now;
+            printStats();
+        }
+    }
+
+    const FrameStats& lastFrame() const {
+        return last;
+    }
+
+    void printStats() const {
+        static const char* names[CategoryCount] = { "program", "vao", "texture", "depth/blend", "framebuffer" };
+        size_t issued = 0, elided = 0;
+        std::cout << "GL state, last frame:";
+        for (int i = 0; i < CategoryCount; ++i) {
+            std::cout << " " << names[i] << " " << last.elided[i] << "/" << last.issued[i] + last.elided[i];
+            issued += last.issued[i];
+            elided += last.elided[i];
+        }
+        std::cout << " elided, " << elided << " of " << issued + elided << " calls skipped, "
+            << last.drawCalls << " draws of " << last.instances << " instances" << std::endl;
+    }
+
+private:
+    GLState() {
+        invalidate();
+    }
+
+    static constexpr GLuint unknown = ~0u;
+    static constexpr unsigned maxUnits = 16;
+    static constexpr int targetCount = 4;
+
+    static int targetIndex(GLenum target) {
+        switch (target) {
+        case GL_TEXTURE_2D:
+            return 0;
+        case GL_TEXTURE_2D_ARRAY:
+            return 1;
+        case GL_TEXTURE_CUBE_MAP:
+            return 2;
+        case GL_TEXTURE_BUFFER:
+            return 3;
+        default:
+            return -1;
+        }
+    }
+
+    // Counts the call, returns true when it has to reach GL
+    bool track(Category category, bool redundant) {
+        ++(redundant ? current.elided : current.issued)[category];
+        return !redundant;
+    }
+
+    void setCapability(GLenum capability, int& shadow, bool enabled) {
+        int value = enabled ? 1 : 0;
+        if (track(DepthBlendCalls, shadow == value)) {
+            shadow = value;
+            if (enabled) {
+                glEnable(capability);
+            }
+            else {
+                glDisable(capability);
+            }
+        }
+    }
+
+    GLuint currentProgram, currentVertexArray, currentFramebuffer;
+    unsigned activeUnit;
+    GLuint textures[maxUnits][targetCount];
+    int depthTest, blend, depthMask;
+    GLenum depthFunc, blendSource, blendDestination;
+
+    FrameStats current, last;
+    std::chrono::steady_clock::time_point lastPrint;
+};
@@ -0,0 +1,183 @@
+#pragma once
+
+#include <glad/gl.h>
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+#include "GLState.h"
+#include "MeshBuilder.h"
+
+// Attribute pointers of a vertex format, for the VAO and GL_ARRAY_BUFFER currently bound
+inline void setVertexAttributes(VertexFormat format) {
+    GLsizei stride = static_cast<GLsizei>(vertexStride(format));
+
+    if (isCompact(format)) {
+        // unorm16 position (padded to 8 bytes) and uv, decoded with the quantization uniforms
+        glVertexAttribPointer(0, 3, GL_UNSIGNED_SHORT, GL_TRUE, stride, (void*)0);
+        glEnableVertexAttribArray(0);
+
+        glVertexAttribPointer(1, 2, GL_UNSIGNED_SHORT, GL_TRUE, stride, (void*)8);
+        glEnableVertexAttribArray(1);
+
+        // Octahedral snorm16 normal, tangent and bitangent
+        glVertexAttribPointer(2, 2, GL_SHORT, GL_TRUE, stride, (void*)12);
+        glEnableVertexAttribArray(2);
+
+        if (hasTangents(format)) {
+            glVertexAttribPointer(3, 2, GL_SHORT, GL_TRUE, stride, (void*)16);
+            glEnableVertexAttribArray(3);
+
+            glVertexAttribPointer(4, 2, GL_SHORT, GL_TRUE, stride, (void*)20);
+            glEnableVertexAttribArray(4);
+        }
+    }
+    else {
+        // Vertex position
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, stride, (void*)0);
+        glEnableVertexAttribArray(0);
+
+        // Texture coordinates
+        glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, stride, (void*)(3 * sizeof(float)));
+        glEnableVertexAttribArray(1);
+
+        // Normals
+        glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, stride, (void*)(5 * sizeof(float)));
+        glEnableVertexAttribArray(2);
+
+        if (hasTangents(format)) {
+            // Tangents
+            glVertexAttribPointer(3, 3, GL_FLOAT, GL_FALSE, stride, (void*)(8 * sizeof(float)));
+            glEnableVertexAttribArray(3);
+
+            // Bitangents
+            glVertexAttribPointer(4, 3, GL_FLOAT, GL_FALSE, stride, (void*)(11 * sizeof(float)));
+            glEnableVertexAttribArray(4);
+        }
+    }
+}
+
+// The vertices and indices of every mesh of one vertex format in one VAO, so meshes are drawn
+// by offset without rebinding and one multi draw can cover all of them. Indices are always
+// 32-bit, 16-bit ones are widened. Space of released meshes is only reused once the pool is
+// empty, the pool is meant for static level geometry.
+class GeometryPool {
+public:
+    // Set at startup when the multi draw path is used, meshes then upload into the pools
+    static inline bool enabled = false;
+
+    struct Range {
+        GLint baseVertex = 0;
+        GLuint firstIndex = 0;
+    };
+
+    static GeometryPool& forFormat(VertexFormat format) {
+        static GeometryPool pools[4] = { GeometryPool(StandardVertices), GeometryPool(TangentVertices),
+            GeometryPool(CompactVertices), GeometryPool(CompactTangentVertices) };
+        return pools[format];
+    }
+
+    GLuint VAO = 0;
+
+    GeometryPool(const GeometryPool&) = delete;
+    GeometryPool& operator=(const GeometryPool&) = delete;
+
+    ~GeometryPool() {
+        if (VAO) {
+            GLState::instance().forgetVertexArray(VAO);
+            glDeleteVertexArrays(1, &VAO);
+            glDeleteBuffers(1, &VBO);
+            glDeleteBuffers(1, &EBO);
+        }
+    }
+
+    Range add(const void* vertexData, GLsizei vertices, const void* indexData, GLsizei indices, size_t indexSize) {
+        size_t stride = vertexStride(format);
+        reserve(vertexCount + static_cast<size_t>(vertices), indexCount + static_cast<size_t>(indices));
+
+        std::vector<uint32_t> widened;
+        if (indexSize == sizeof(uint16_t)) {
+            const uint16_t* source = static_cast<const uint16_t*>(indexData);
+            widened.assign(source, source + indices);
+            indexData = widened.data();
+        }
+
+        // The copy targets leave the element buffer binding of whatever VAO is bound alone
+        glBindBuffer(GL_COPY_WRITE_BUFFER, VBO);
+        glBufferSubData(GL_COPY_WRITE_BUFFER, static_cast<GLintptr>(vertexCount * stride),
+            static_cast<GLsizeiptr>(vertices) * stride, vertexData);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, EBO);
+        glBufferSubData(GL_COPY_WRITE_BUFFER, static_cast<GLintptr>(indexCount * sizeof(uint32_t)),
+            static_cast<GLsizeiptr>(indices) * sizeof(uint32_t), indexData);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+        Range range;
+        range.baseVertex = static_cast<GLint>(vertexCount);
+        range.firstIndex = static_cast<GLuint>(indexCount);
+        vertexCount += static_cast<size_t>(vertices);
+        indexCount += static_cast<size_t>(indices);
+        ++meshes;
+        return range;
+    }
+
+    void release() {
+        if (meshes > 0 && --meshes == 0) {
+            vertexCount = 0;
+            indexCount = 0;
+        }
+    }
+
+private:
+    explicit GeometryPool(VertexFormat format) : format(format) {}
+
+    void reserve(size_t vertices, size_t indices) {
+        bool grown = false;
+        if (vertices > vertexCapacity) {
+            size_t capacity = std::max({ vertices, vertexCapacity * 2, size_t(1) << 16 });
+            VBO = grow(VBO, vertexCount * vertexStride(format), capacity * vertexStride(format));
+            vertexCapacity = capacity;
+            grown = true;
+        }
+        if (indices > indexCapacity) {
+            size_t capacity = std::max({ indices, indexCapacity * 2, size_t(1) << 18 });
+            EBO = grow(EBO, indexCount * sizeof(uint32_t), capacity * sizeof(uint32_t));
+            indexCapacity = capacity;
+            grown = true;
+        }
+        if (!grown) {
+            return;
+        }
+
+        // Attribute pointers keep the buffer they were set with, point them at the new ones
+        if (!VAO) {
+            glGenVertexArrays(1, &VAO);
+        }
+        GLState::instance().bindVertexArray(VAO);
+        glBindBuffer(GL_ARRAY_BUFFER, VBO);
+        setVertexAttributes(format);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+        GLState::instance().bindVertexArray(0);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+    }
+
+    // New buffer of newBytes holding the first usedBytes of old, which is deleted
+    static GLuint grow(GLuint old, size_t usedBytes, size_t newBytes) {
+        GLuint buffer = 0;
+        glGenBuffers(1, &buffer);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+        glBufferData(GL_COPY_WRITE_BUFFER, static_cast<GLsizeiptr>(newBytes), nullptr, GL_STATIC_DRAW);
+        if (old) {
+            glBindBuffer(GL_COPY_READ_BUFFER, old);
+            glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, static_cast<GLsizeiptr>(usedBytes));
+            glBindBuffer(GL_COPY_READ_BUFFER, 0);
+            glDeleteBuffers(1, &old);
+        }
+        glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+        return buffer;
+    }
+
+    VertexFormat format;
+    GLuint VBO = 0, EBO = 0;
+    size_t vertexCount = 0, indexCount = 0;
+    size_t vertexCapacity = 0, indexCapacity = 0;
+    size_t meshes = 0;
+};
@@ -0,0 +1,86 @@
+#pragma once
+
+#include <glad/gl.h>
+#include <algorithm>
+#include <cstddef>
+#include <vector>
+#include <glm/glm.hpp>
+#include "GLState.h"
+
+// Per instance data of an instanced draw, read by the INSTANCED variants of the model shaders
+struct InstanceData {
+    glm::mat4 transform;
+    glm::mat3 normalMatrix;
+    glm::ivec4 material;  // texture layers of slots 1-3 and the material index
+    GLint drawIndex = 0;  // command of a multi draw, for its DrawData
+};
+
+static_assert(sizeof(InstanceData) == 120, "InstanceData must be tightly packed for the attribute offsets");
+
+// One stream buffer with the instances of every instanced draw of a frame. Each draw points
+// the instance attributes of its vertex array at its own range, GL 3.3 has no base instance.
+// Multi draws attach the whole buffer and select their range with the commands' baseInstance.
+class InstanceBuffer {
+public:
+    // mat4 at 5-8, mat3 at 9-11, ivec4 at 12, int at 13
+    static constexpr GLuint firstAttribute = 5;
+
+    GLuint ID = 0;
+
+    InstanceBuffer() = default;
+    InstanceBuffer(const InstanceBuffer&) = delete;
+    InstanceBuffer& operator=(const InstanceBuffer&) = delete;
+
+    ~InstanceBuffer() {
+        if (ID) {
+            glDeleteBuffers(1, &ID);
+        }
+    }
+
+    // Orphans the previous storage, draws of the last frame can still be reading it
+    void upload(const std::vector<InstanceData>& instances) {
+        if (instances.empty()) {
+            return;
+        }
+        if (!ID) {
+            glGenBuffers(1, &ID);
+        }
+        capacity = std::max(capacity, instances.size());
+
+        glBindBuffer(GL_ARRAY_BUFFER, ID);
+        glBufferData(GL_ARRAY_BUFFER, static_cast<GLsizeiptr>(capacity * sizeof(InstanceData)), nullptr, GL_STREAM_DRAW);
+        glBufferSubData(GL_ARRAY_BUFFER, 0, static_cast<GLsizeiptr>(instances.size() * sizeof(InstanceData)), instances.data());
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+    }
+
+    // Points the instance attributes of the bound vertex array at the instances from first on
+    void attach(size_t first) const {
+        const GLsizei stride = sizeof(InstanceData);
+        size_t base = first * sizeof(InstanceData);
+
+        glBindBuffer(GL_ARRAY_BUFFER, ID);
+        for (GLuint column = 0; column < 4; ++column) {
+            size_t offset = base + offsetof(InstanceData, transform) + column * sizeof(glm::vec4);
+            enable(firstAttribute + column);
+            glVertexAttribPointer(firstAttribute + column, 4, GL_FLOAT, GL_FALSE, stride, (void*)offset);
+        }
+        for (GLuint column = 0; column < 3; ++column) {
+            size_t offset = base + offsetof(InstanceData, normalMatrix) + column * sizeof(glm::vec3);
+            enable(firstAttribute + 4 + column);
+            glVertexAttribPointer(firstAttribute + 4 + column, 3, GL_FLOAT, GL_FALSE, stride, (void*)offset);
+        }
+        enable(firstAttribute + 7);
+        glVertexAttribIPointer(firstAttribute + 7, 4, GL_INT, stride, (void*)(base + offsetof(InstanceData, material)));
+        enable(firstAttribute + 8);
+        glVertexAttribIPointer(firstAttribute + 8, 1, GL_INT, stride, (void*)(base + offsetof(InstanceData, drawIndex)));
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+    }
+
+private:
+    static void enable(GLuint attribute) {
+        glEnableVertexAttribArray(attribute);
+        glVertexAttribDivisor(attribute, 1);
+    }
+
+    size_t capacity = 0;
+};
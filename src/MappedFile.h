@@ -0,0 +1,160 @@
+#pragma once
+
+#include <string>
+#include <cstddef>
+#include <utility>
+
+#ifdef _WIN32
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// Read-only memory mapping of a whole file. The contents are not null terminated,
+// always use size() when walking the data.
+class MappedFile {
+public:
+    MappedFile() = default;
+
+    explicit MappedFile(const std::string& path) {
+        open(path);
+    }
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    MappedFile(MappedFile&& other) noexcept {
+        *this = std::move(other);
+    }
+
+    MappedFile& operator=(MappedFile&& other) noexcept {
+        if (this != &other) {
+            close();
+            dataPtr = other.dataPtr;
+            length = other.length;
+            opened = other.opened;
+#ifdef _WIN32
+            fileHandle = other.fileHandle;
+            mappingHandle = other.mappingHandle;
+            other.fileHandle = INVALID_HANDLE_VALUE;
+            other.mappingHandle = nullptr;
+#endif
+            other.dataPtr = nullptr;
+            other.length = 0;
+            other.opened = false;
+        }
+        return *this;
+    }
+
+    ~MappedFile() {
+        close();
+    }
+
+    bool open(const std::string& path) {
+        close();
+#ifdef _WIN32
+        fileHandle = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr,
+            OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+        if (fileHandle == INVALID_HANDLE_VALUE) {
+            return false;
+        }
+
+        LARGE_INTEGER fileSize;
+        if (!GetFileSizeEx(fileHandle, &fileSize)) {
+            close();
+            return false;
+        }
+        length = static_cast<size_t>(fileSize.QuadPart);
+        if (length == 0) {
+            // Empty files cannot be mapped, treat them as a valid empty view
+            opened = true;
+            return true;
+        }
+
+        mappingHandle = CreateFileMappingA(fileHandle, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        if (!mappingHandle) {
+            close();
+            return false;
+        }
+
+        dataPtr = static_cast<const char*>(MapViewOfFile(mappingHandle, FILE_MAP_READ, 0, 0, 0));
+        if (!dataPtr) {
+            close();
+            return false;
+        }
+#else
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0) {
+            return false;
+        }
+
+        struct stat st;
+        if (fstat(fd, &st) != 0) {
+            ::close(fd);
+            return false;
+        }
+        length = static_cast<size_t>(st.st_size);
+        if (length == 0) {
+            ::close(fd);
+            opened = true;
+            return true;
+        }
+
+        void* mapped = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+        ::close(fd);
+        if (mapped == MAP_FAILED) {
+            length = 0;
+            return false;
+        }
+        madvise(mapped, length, MADV_SEQUENTIAL);
+        dataPtr = static_cast<const char*>(mapped);
+#endif
+        opened = true;
+        return true;
+    }
+
+    void close() {
+#ifdef _WIN32
+        if (dataPtr) {
+            UnmapViewOfFile(dataPtr);
+        }
+        if (mappingHandle) {
+            CloseHandle(mappingHandle);
+            mappingHandle = nullptr;
+        }
+        if (fileHandle != INVALID_HANDLE_VALUE) {
+            CloseHandle(fileHandle);
+            fileHandle = INVALID_HANDLE_VALUE;
+        }
+#else
+        if (dataPtr) {
+            munmap(const_cast<char*>(dataPtr), length);
+        }
+#endif
+        dataPtr = nullptr;
+        length = 0;
+        opened = false;
+    }
+
+    bool isOpen() const { return opened; }
+    const char* data() const { return dataPtr; }
+    size_t size() const { return length; }
+
+private:
+    const char* dataPtr = nullptr;
+    size_t length = 0;
+    bool opened = false;
+#ifdef _WIN32
+    HANDLE fileHandle = INVALID_HANDLE_VALUE;
+    HANDLE mappingHandle = nullptr;
+#endif
+};
@@ -0,0 +1,343 @@
+#pragma once
+
+#include <glad/gl.h>
+#include <iostream>
+#include <vector>
+#include <string>
+#include <memory>
+#include <limits>
+#include <filesystem>
+#include <unordered_map>
+#include "GLState.h"
+#include "ObjParser.h"
+#include "MeshCache.h"
+#include "MeshBuilder.h"
+#include "MeshOptimizer.h"
+#include "GeometryPool.h"
+#include <glm/glm.hpp>
+#include <glm/gtc/type_ptr.hpp>
+
+struct AABB {
+    glm::vec3 min;
+    glm::vec3 max;
+};
+
+// GPU geometry of one OBJ file in one vertex format, shared by every Model placing it.
+// The parsed OBJ data only lives until upload() and is shared with the other formats of the same file.
+class Mesh {
+public:
+    std::string path;
+    VertexFormat format = StandardVertices;
+    MeshCache::SourceInfo source;
+    bool hasSource = false;
+
+    GLuint VAO = 0, VBO = 0, EBO = 0;
+    // Pooled meshes draw from their range of the GeometryPool VAO and own no buffers
+    bool pooled = false;
+    GLint baseVertex = 0;
+    GLuint firstIndex = 0;
+    uint32_t id = nextId++;  // unique per mesh, for sorting draws, pooled meshes share the VAO
+    GLsizei vertexCount = 0;
+    GLsizei indexCount = 0;
+    GLenum indexType = GL_UNSIGNED_INT;
+    VertexQuantization quantization;
+    AABB aabb = { glm::vec3(0.0f), glm::vec3(0.0f) };
+
+    std::shared_ptr<const ObjData> parsed;
+    // CPU copy of the triangles, only for meshes that can be occluders, see OcclusionCuller
+    OccluderGeometry occluder;
+
+    // Threads used by the OBJ parser, 0 = all hardware threads, 1 = single threaded
+    static inline unsigned loaderThreads = 0;
+    // Read and write <obj>.<format>.jdmesh files next to the sources
+    static inline bool useMeshCache = true;
+    // Reorder triangles and vertices for the post-transform cache before upload
+    static inline bool optimizeMeshes = true;
+    // Quantized 16/24 byte vertices instead of 32/56 byte float ones
+    static inline bool compactVertices = true;
+    // Keep an OccluderGeometry of meshes with at most maxOccluderTriangles, set when occlusion culling is on
+    static inline bool keepOccluders = false;
+    static inline size_t maxOccluderTriangles = 4096;
+
+    Mesh(const std::string& path, VertexFormat format) : path(path), format(format) {}
+    Mesh(const Mesh&) = delete;
+    Mesh& operator=(const Mesh&) = delete;
+
+    ~Mesh() {
+        if (pooled) {
+            GeometryPool::forFormat(format).release();
+            return;
+        }
+        if (VAO) {
+            GLState::instance().forgetVertexArray(VAO);
+            glDeleteVertexArrays(1, &VAO);
+        }
+        if (VBO) {
+            glDeleteBuffers(1, &VBO);
+        }
+        if (EBO) {
+            glDeleteBuffers(1, &EBO);
+        }
+    }
+
+    bool isUploaded() const {
+        return VAO != 0;
+    }
+
+    size_t gpuBytes() const {
+        size_t indexSize = indexType == GL_UNSIGNED_SHORT ? sizeof(uint16_t) : sizeof(uint32_t);
+        return static_cast<size_t>(vertexCount) * vertexStride(format) + static_cast<size_t>(indexCount) * indexSize;
+    }
+
+    // Reads the bounds, from any valid cache file if possible, otherwise by parsing the OBJ (or reusing shared)
+    bool load(std::shared_ptr<const ObjData> shared = nullptr) {
+        std::cout << "Loading mesh from file: " << path << std::endl;
+
+        source.path = path;
+        hasSource = MeshCache::querySource(path, source);
+
+        MeshCache::Header header;
+        if (useMeshCache && hasSource &&
+            (MeshCache::peek(source, format, header) || MeshCache::peek(source, StandardVertices, header) ||
+             MeshCache::peek(source, TangentVertices, header) || MeshCache::peek(source, CompactVertices, header) ||
+             MeshCache::peek(source, CompactTangentVertices, header))) {
+            aabb = { glm::make_vec3(header.aabbMin), glm::make_vec3(header.aabbMax) };
+            parsed = std::move(shared);
+            return true;
+        }
+
+        if (shared) {
+            parsed = std::move(shared);
+            calculateAABB();
+            return true;
+        }
+        return parse();
+    }
+
+    bool parse() {
+        auto data = std::make_shared<ObjData>();
+        if (!ObjParser::parseFile(path, *data, loaderThreads)) {
+            std::cerr << "Failed to open OBJ file: " << path << std::endl;
+            return false;
+        }
+        parsed = std::move(data);
+        calculateAABB();
+        return true;
+    }
+
+    void calculateAABB() {
+        glm::vec3 min = glm::vec3(std::numeric_limits<float>::max());
+        glm::vec3 max = glm::vec3(std::numeric_limits<float>::lowest());
+
+        for (const auto& vertex : parsed->vertices) {
+            min = glm::min(min, glm::vec3(vertex.x, vertex.y, vertex.z));
+            max = glm::max(max, glm::vec3(vertex.x, vertex.y, vertex.z));
+        }
+
+        aabb = { min, max };
+    }
+
+    // Creates the GPU buffers once, later calls (other placements of the same mesh) do nothing
+    bool upload() {
+        if (isUploaded()) {
+            return true;
+        }
+
+        MeshCache::Entry cached;
+        if (useMeshCache && hasSource && MeshCache::load(source, format, optimizeMeshes, cached)) {
+            std::cout << "Setting up buffers from cache: " << MeshCache::cachePath(source.path, format) << std::endl;
+            const MeshCache::Header& header = cached.header();
+            quantization = header.quantization();
+            uploadBuffers(cached.vertexData(), static_cast<GLsizei>(header.vertexCount),
+                cached.indexData(), static_cast<GLsizei>(header.indexCount), header.indexSize);
+            parsed.reset();
+            return true;
+        }
+
+        // The text was skipped in load because a cache existed, but not for this format
+        if (!parsed && !parse()) {
+            return false;
+        }
+
+        std::cout << "Setting up buffers..." << (hasTangents(format) ? " Parallax" : "") << std::endl;
+
+        IndexedMesh mesh = MeshBuilder::build(parsed->vertices, parsed->texCoords, parsed->normals, parsed->faces,
+            hasTangents(format) ? TangentVertices : StandardVertices);
+        MeshBuilder::printStats(path, mesh);
+        if (optimizeMeshes) {
+            MeshOptimizer::optimize(path, mesh);
+        }
+
+        // Narrow to 16 bit indices when possible, halving the index buffer
+        std::vector<uint16_t> shortIndices;
+        const void* indexData = mesh.indices.data();
+        if (mesh.indexSize() == sizeof(uint16_t)) {
+            shortIndices.assign(mesh.indices.begin(), mesh.indices.end());
+            indexData = shortIndices.data();
+        }
+
+        std::vector<uint8_t> compactData;
+        const void* vertexData = mesh.vertexData.data();
+        quantization = VertexQuantization();
+        if (isCompact(format)) {
+            compactData = MeshBuilder::quantize(mesh, aabb.min, aabb.max, quantization);
+            vertexData = compactData.data();
+        }
+
+        uploadBuffers(vertexData, static_cast<GLsizei>(mesh.vertexCount()),
+            indexData, static_cast<GLsizei>(mesh.indices.size()), mesh.indexSize());
+
+        if (useMeshCache && hasSource) {
+            MeshCache::MeshView view = {
+                static_cast<uint32_t>(vertexStride(format)),
+                static_cast<uint32_t>(mesh.vertexCount()),
+                vertexData,
+                static_cast<uint32_t>(mesh.indexSize()),
+                static_cast<uint32_t>(mesh.indices.size()),
+                indexData,
+                &aabb.min[0],
+                &aabb.max[0],
+                quantization,
+                optimizeMeshes
+            };
+            MeshCache::store(source, format, view);
+        }
+
+        parsed.reset();
+        std::cout << "Buffers setup complete." << std::endl;
+        return true;
+    }
+
+    void uploadBuffers(const void* vertexData, GLsizei vertices, const void* indexData, GLsizei indices, size_t indexSize) {
+        vertexCount = vertices;
+        indexCount = indices;
+
+        if (keepOccluders && static_cast<size_t>(indices) / 3 <= maxOccluderTriangles) {
+            occluder = MeshBuilder::extractPositions(format, quantization, vertexData, static_cast<size_t>(vertices),
+                indexData, static_cast<size_t>(indices), indexSize);
+        }
+
+        if (GeometryPool::enabled) {
+            GeometryPool& pool = GeometryPool::forFormat(format);
+            GeometryPool::Range range = pool.add(vertexData, vertices, indexData, indices, indexSize);
+            VAO = pool.VAO;
+            baseVertex = range.baseVertex;
+            firstIndex = range.firstIndex;
+            indexType = GL_UNSIGNED_INT;
+            pooled = true;
+            return;
+        }
+
+        glGenVertexArrays(1, &VAO);
+        glGenBuffers(1, &VBO);
+        glGenBuffers(1, &EBO);
+
+        GLState::instance().bindVertexArray(VAO);
+
+        glBindBuffer(GL_ARRAY_BUFFER, VBO);
+        glBufferData(GL_ARRAY_BUFFER, static_cast<GLsizeiptr>(vertices) * vertexStride(format), vertexData, GL_STATIC_DRAW);
+
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, static_cast<GLsizeiptr>(indices) * indexSize, indexData, GL_STATIC_DRAW);
+
+        setVertexAttributes(format);
+
+        GLState::instance().bindVertexArray(0);
+
+        indexType = indexSize == sizeof(uint16_t) ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT;
+    }
+
+    // Leaves the VAO bound, the next draw of the same mesh skips the bind
+    void draw() const {
+        GLState::instance().bindVertexArray(VAO);
+        glDrawElementsBaseVertex(GL_TRIANGLES, indexCount, indexType, indexOffset(), baseVertex);
+        GLState::instance().countDraw();
+    }
+
+    // The instance attributes must have been attached to the VAO, see InstanceBuffer::attach
+    void drawInstanced(GLsizei instances) const {
+        GLState::instance().bindVertexArray(VAO);
+        glDrawElementsInstancedBaseVertex(GL_TRIANGLES, indexCount, indexType, indexOffset(), instances, baseVertex);
+        GLState::instance().countDraw(static_cast<size_t>(instances));
+    }
+
+    void* indexOffset() const {
+        size_t indexSize = indexType == GL_UNSIGNED_SHORT ? sizeof(uint16_t) : sizeof(uint32_t);
+        return reinterpret_cast<void*>(static_cast<uintptr_t>(firstIndex) * indexSize);
+    }
+
+private:
+    static inline uint32_t nextId = 0;
+};
+
+// Hands out one shared Mesh per (path, vertex format). Entries are weak, a mesh is freed
+// together with its GPU buffers when the last Model using it goes away.
+class MeshRegistry {
+public:
+    static MeshRegistry& instance() {
+        static MeshRegistry registry;
+        return registry;
+    }
+
+    std::shared_ptr<Mesh> acquire(const std::string& path, VertexFormat format) {
+        std::string normalized = std::filesystem::path(path).lexically_normal().generic_string();
+        std::string key = normalized + "|" + std::to_string(format);
+
+        auto it = meshes.find(key);
+        if (it != meshes.end()) {
+            if (auto mesh = it->second.lock()) {
+                ++hits;
+                return mesh;
+            }
+        }
+
+        auto mesh = std::make_shared<Mesh>(normalized, format);
+        if (!mesh->load(findParsed(normalized))) {
+            return nullptr;
+        }
+        meshes[key] = mesh;
+        return mesh;
+    }
+
+    // Drops entries whose meshes have been released
+    void collectGarbage() {
+        for (auto it = meshes.begin(); it != meshes.end();) {
+            if (it->second.expired()) {
+                it = meshes.erase(it);
+            }
+            else {
+                ++it;
+            }
+        }
+    }
+
+    void printStats() const {
+        size_t unique = 0, references = 0, bytes = 0;
+        for (const auto& entry : meshes) {
+            if (auto mesh = entry.second.lock()) {
+                ++unique;
+                references += static_cast<size_t>(mesh.use_count()) - 1;
+                bytes += mesh->gpuBytes();
+            }
+        }
+        std::cout << "Meshes: " << unique << " unique, " << references << " references, "
+            << hits << " shared loads, " << bytes / 1024 << " KB GPU" << std::endl;
+    }
+
+private:
+    MeshRegistry() = default;
+
+    // Parsed OBJ data of another format of the same file that has not been uploaded yet
+    std::shared_ptr<const ObjData> findParsed(const std::string& path) const {
+        for (const auto& entry : meshes) {
+            auto mesh = entry.second.lock();
+            if (mesh && mesh->path == path && mesh->parsed) {
+                return mesh->parsed;
+            }
+        }
+        return nullptr;
+    }
+
+    std::unordered_map<std::string, std::weak_ptr<Mesh>> meshes;
+    size_t hits = 0;
+};
@@ -0,0 +1,333 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+#include <cmath>
+#include <cstring>
+#include <algorithm>
+#include <unordered_map>
+#include <iostream>
+#include <glm/glm.hpp>
+#include "ObjParser.h"
+
+enum VertexFormat
+{
+    StandardVertices = 0,       // position, uv, normal as floats
+    TangentVertices = 1,        // position, uv, normal, tangent, bitangent as floats
+    CompactVertices = 2,        // unorm16 position and uv, octahedral snorm16 normal
+    CompactTangentVertices = 3  // CompactVertices plus octahedral tangent and bitangent
+};
+
+inline bool hasTangents(VertexFormat format) {
+    return format == TangentVertices || format == CompactTangentVertices;
+}
+
+inline bool isCompact(VertexFormat format) {
+    return format == CompactVertices || format == CompactTangentVertices;
+}
+
+inline size_t floatsPerVertex(VertexFormat format) {
+    return hasTangents(format) ? 14 : 8;
+}
+
+// Bytes per vertex in the GPU buffer
+inline size_t vertexStride(VertexFormat format) {
+    switch (format) {
+    case CompactVertices:
+        return 16;
+    case CompactTangentVertices:
+        return 24;
+    default:
+        return floatsPerVertex(format) * sizeof(float);
+    }
+}
+
+// Maps the unorm16 attributes of the compact formats back to object space:
+// position = positionOffset + attribute * positionScale, same for uv
+struct VertexQuantization {
+    glm::vec3 positionOffset = glm::vec3(0.0f);
+    glm::vec3 positionScale = glm::vec3(1.0f);
+    glm::vec2 uvOffset = glm::vec2(0.0f);
+    glm::vec2 uvScale = glm::vec2(1.0f);
+};
+
+// Deduplicated interleaved vertices plus a triangle list indexing them
+struct IndexedMesh {
+    VertexFormat format = StandardVertices;
+    std::vector<float> vertexData;
+    std::vector<uint32_t> indices;
+
+    size_t vertexCount() const {
+        return vertexData.size() / floatsPerVertex(format);
+    }
+
+    // 16 bit indices whenever every vertex is addressable with them
+    size_t indexSize() const {
+        return vertexCount() <= 0xFFFF ? sizeof(uint16_t) : sizeof(uint32_t);
+    }
+};
+
+// Positions and triangles of a mesh kept on the CPU for the occlusion rasterizer
+struct OccluderGeometry {
+    std::vector<glm::vec3> positions;
+    std::vector<uint32_t> indices;
+
+    bool empty() const {
+        return indices.empty();
+    }
+};
+
+namespace MeshBuilder {
+
+    struct CornerKey {
+        int v, t, n;
+
+        bool operator==(const CornerKey& other) const {
+            return v == other.v && t == other.t && n == other.n;
+        }
+    };
+
+    struct CornerKeyHash {
+        size_t operator()(const CornerKey& key) const {
+            uint64_t h = static_cast<uint32_t>(key.v) * 0x9E3779B97F4A7C15ull;
+            h ^= (static_cast<uint32_t>(key.t) + 0x632BE59BD9B4E019ull) * 0xC2B2AE3D27D4EB4Full;
+            h ^= (static_cast<uint32_t>(key.n) + 0x85EBCA77C2B2AE63ull) * 0x165667B19E3779F9ull;
+            return static_cast<size_t>(h ^ (h >> 29));
+        }
+    };
+
+    inline bool isFinite(const glm::vec3& v) {
+        return std::isfinite(v.x) && std::isfinite(v.y) && std::isfinite(v.z);
+    }
+
+    // Builds one vertex per unique (v, t, n) corner. For TangentVertices the per-face
+    // tangent and bitangent are accumulated on every vertex using them and normalized at the end.
+    inline IndexedMesh build(const std::vector<Vertex>& vertices, const std::vector<TexCoord>& texCoords,
+        const std::vector<Normal>& normals, const std::vector<Face>& faces, VertexFormat format) {
+        IndexedMesh mesh;
+        mesh.format = format;
+        mesh.indices.reserve(faces.size() * 3);
+
+        const size_t stride = floatsPerVertex(format);
+        std::unordered_map<CornerKey, uint32_t, CornerKeyHash> lookup;
+        lookup.reserve(faces.size() * 3);
+
+        auto texCoordOf = [&](int t) {
+            return t >= 0 && static_cast<size_t>(t) < texCoords.size()
+                ? glm::vec2(texCoords[t].u, texCoords[t].v)
+                : glm::vec2(0.0f);
+        };
+
+        for (const auto& face : faces) {
+            uint32_t corner[3];
+            for (int i = 0; i < 3; ++i) {
+                CornerKey key = { face.v[i], face.t[i], face.n[i] };
+                auto inserted = lookup.emplace(key, static_cast<uint32_t>(lookup.size()));
+                corner[i] = inserted.first->second;
+
+                if (inserted.second) {
+                    const auto& v = vertices[face.v[i]];
+                    glm::vec2 tc = texCoordOf(face.t[i]);
+                    glm::vec3 n(0.0f);
+                    if (face.n[i] >= 0 && static_cast<size_t>(face.n[i]) < normals.size()) {
+                        n = glm::vec3(normals[face.n[i]].x, normals[face.n[i]].y, normals[face.n[i]].z);
+                    }
+
+                    mesh.vertexData.insert(mesh.vertexData.end(), { v.x, v.y, v.z, tc.x, tc.y, n.x, n.y, n.z });
+                    if (format == TangentVertices) {
+                        mesh.vertexData.insert(mesh.vertexData.end(), 6, 0.0f);
+                    }
+                }
+                mesh.indices.push_back(corner[i]);
+            }
+
+            if (format != TangentVertices) {
+                continue;
+            }
+
+            glm::vec3 pos[3];
+            glm::vec2 tex[3];
+            for (int i = 0; i < 3; ++i) {
+                pos[i] = glm::vec3(vertices[face.v[i]].x, vertices[face.v[i]].y, vertices[face.v[i]].z);
+                tex[i] = texCoordOf(face.t[i]);
+            }
+
+            glm::vec3 edge1 = pos[1] - pos[0];
+            glm::vec3 edge2 = pos[2] - pos[0];
+            glm::vec2 deltaUV1 = tex[1] - tex[0];
+            glm::vec2 deltaUV2 = tex[2] - tex[0];
+
+            float f = 1.0f / (deltaUV1.x * deltaUV2.y - deltaUV2.x * deltaUV1.y);
+            glm::vec3 tangent = glm::normalize(f * (deltaUV2.y * edge1 - deltaUV1.y * edge2));
+            glm::vec3 bitangent = glm::normalize(f * (-deltaUV2.x * edge1 + deltaUV1.x * edge2));
+
+            // Degenerate UVs give no usable frame, leave the shared vertices untouched
+            if (!isFinite(tangent) || !isFinite(bitangent)) {
+                continue;
+            }
+
+            for (int i = 0; i < 3; ++i) {
+                float* vertex = &mesh.vertexData[corner[i] * stride];
+                vertex[8] += tangent.x;
+                vertex[9] += tangent.y;
+                vertex[10] += tangent.z;
+                vertex[11] += bitangent.x;
+                vertex[12] += bitangent.y;
+                vertex[13] += bitangent.z;
+            }
+        }
+
+        if (format == TangentVertices) {
+            for (size_t i = 0; i < mesh.vertexData.size(); i += stride) {
+                float* vertex = &mesh.vertexData[i];
+                glm::vec3 n(vertex[5], vertex[6], vertex[7]);
+                glm::vec3 t(vertex[8], vertex[9], vertex[10]);
+                glm::vec3 b(vertex[11], vertex[12], vertex[13]);
+
+                // Gram-Schmidt against the normal so averaged tangents stay in the surface plane,
+                // then the bitangent is rebuilt from both so the basis is orthonormal. The sign of
+                // the accumulated bitangent keeps mirrored UVs mirrored.
+                if (glm::dot(n, n) > 0.0f) {
+                    n = glm::normalize(n);
+                    t -= n * glm::dot(n, t);
+                    if (glm::dot(t, t) <= 0.0f) {
+                        t = glm::cross(n, std::abs(n.x) < 0.9f ? glm::vec3(1.0f, 0.0f, 0.0f) : glm::vec3(0.0f, 1.0f, 0.0f));
+                    }
+                    t = glm::normalize(t);
+                    glm::vec3 c = glm::cross(n, t);
+                    b = glm::dot(c, b) < 0.0f ? -c : c;
+                }
+                else {
+                    t = glm::dot(t, t) > 0.0f ? glm::normalize(t) : glm::vec3(1.0f, 0.0f, 0.0f);
+                    b = glm::dot(b, b) > 0.0f ? glm::normalize(b) : glm::vec3(0.0f, 1.0f, 0.0f);
+                }
+
+                vertex[8] = t.x;  vertex[9] = t.y;  vertex[10] = t.z;
+                vertex[11] = b.x; vertex[12] = b.y; vertex[13] = b.z;
+            }
+        }
+
+        return mesh;
+    }
+
+    inline uint16_t quantizeUnorm16(float value, float offset, float scale) {
+        float normalized = scale != 0.0f ? (value - offset) / scale : 0.0f;
+        return static_cast<uint16_t>(std::lround(std::min(std::max(normalized, 0.0f), 1.0f) * 65535.0f));
+    }
+
+    inline int16_t quantizeSnorm16(float value) {
+        return static_cast<int16_t>(std::lround(std::min(std::max(value, -1.0f), 1.0f) * 32767.0f));
+    }
+
+    // Octahedral mapping of a unit vector onto [-1, 1]^2, a zero vector maps to +Z
+    inline glm::vec2 octahedralEncode(glm::vec3 n) {
+        float length = std::abs(n.x) + std::abs(n.y) + std::abs(n.z);
+        if (length == 0.0f) {
+            return glm::vec2(0.0f);
+        }
+        n /= length;
+
+        glm::vec2 p(n.x, n.y);
+        if (n.z < 0.0f) {
+            p = glm::vec2((1.0f - std::abs(n.y)) * (n.x >= 0.0f ? 1.0f : -1.0f),
+                (1.0f - std::abs(n.x)) * (n.y >= 0.0f ? 1.0f : -1.0f));
+        }
+        return p;
+    }
+
+    // Converts a float mesh into the matching compact format. Positions are quantized
+    // inside [boundsMin, boundsMax], texture coordinates inside their own range.
+    inline std::vector<uint8_t> quantize(const IndexedMesh& mesh, const glm::vec3& boundsMin, const glm::vec3& boundsMax,
+        VertexQuantization& quantization) {
+        const size_t floats = floatsPerVertex(mesh.format);
+        const bool tangents = hasTangents(mesh.format);
+        const size_t stride = vertexStride(tangents ? CompactTangentVertices : CompactVertices);
+        const size_t count = mesh.vertexCount();
+
+        glm::vec2 uvMin(0.0f), uvMax(0.0f);
+        if (count > 0) {
+            uvMin = uvMax = glm::vec2(mesh.vertexData[3], mesh.vertexData[4]);
+        }
+        for (size_t i = 0; i < count; ++i) {
+            glm::vec2 uv(mesh.vertexData[i * floats + 3], mesh.vertexData[i * floats + 4]);
+            uvMin = glm::min(uvMin, uv);
+            uvMax = glm::max(uvMax, uv);
+        }
+
+        quantization.positionOffset = boundsMin;
+        quantization.positionScale = boundsMax - boundsMin;
+        quantization.uvOffset = uvMin;
+        quantization.uvScale = uvMax - uvMin;
+
+        std::vector<uint8_t> bytes(count * stride);
+        for (size_t i = 0; i < count; ++i) {
+            const float* src = &mesh.vertexData[i * floats];
+            uint16_t position[4] = {
+                quantizeUnorm16(src[0], quantization.positionOffset.x, quantization.positionScale.x),
+                quantizeUnorm16(src[1], quantization.positionOffset.y, quantization.positionScale.y),
+                quantizeUnorm16(src[2], quantization.positionOffset.z, quantization.positionScale.z),
+                0
+            };
+            uint16_t uv[2] = {
+                quantizeUnorm16(src[3], quantization.uvOffset.x, quantization.uvScale.x),
+                quantizeUnorm16(src[4], quantization.uvOffset.y, quantization.uvScale.y)
+            };
+            glm::vec2 n = octahedralEncode(glm::vec3(src[5], src[6], src[7]));
+            int16_t normal[2] = { quantizeSnorm16(n.x), quantizeSnorm16(n.y) };
+
+            uint8_t* dst = &bytes[i * stride];
+            std::memcpy(dst, position, sizeof(position));
+            std::memcpy(dst + 8, uv, sizeof(uv));
+            std::memcpy(dst + 12, normal, sizeof(normal));
+
+            if (tangents) {
+                glm::vec2 t = octahedralEncode(glm::vec3(src[8], src[9], src[10]));
+                glm::vec2 b = octahedralEncode(glm::vec3(src[11], src[12], src[13]));
+                int16_t frame[4] = { quantizeSnorm16(t.x), quantizeSnorm16(t.y), quantizeSnorm16(b.x), quantizeSnorm16(b.y) };
+                std::memcpy(dst + 16, frame, sizeof(frame));
+            }
+        }
+        return bytes;
+    }
+
+    inline void printStats(const std::string& name, const IndexedMesh& mesh) {
+        size_t corners = mesh.indices.size();
+        size_t unique = mesh.vertexCount();
+        size_t vertexBytes = floatsPerVertex(mesh.format) * sizeof(float);
+        size_t expanded = corners * vertexBytes;
+        size_t indexed = unique * vertexBytes + corners * mesh.indexSize();
+
+        std::cout << "Indexed " << name << ": " << corners << " corners -> " << unique << " unique vertices ("
+            << (unique ? static_cast<double>(corners) / unique : 0.0) << "x reuse), "
+            << expanded << " -> " << indexed << " bytes with "
+            << mesh.indexSize() * 8 << " bit indices" << std::endl;
+    }
+
+    // Decodes the positions of uploaded vertex data of any format, compact ones with their quantization
+    inline OccluderGeometry extractPositions(VertexFormat format, const VertexQuantization& quantization,
+        const void* vertexData, size_t vertices, const void* indexData, size_t indices, size_t indexSize) {
+        OccluderGeometry geometry;
+        const uint8_t* bytes = static_cast<const uint8_t*>(vertexData);
+        const size_t stride = vertexStride(format);
+
+        geometry.positions.resize(vertices);
+        for (size_t i = 0; i < vertices; ++i) {
+            if (isCompact(format)) {
+                uint16_t position[3];
+                std::memcpy(position, bytes + i * stride, sizeof(position));
+                geometry.positions[i] = quantization.positionOffset +
+                    glm::vec3(position[0], position[1], position[2]) / 65535.0f * quantization.positionScale;
+            }
+            else {
+                std::memcpy(&geometry.positions[i], bytes + i * stride, sizeof(glm::vec3));
+            }
+        }
+
+        geometry.indices.resize(indices);
+        for (size_t i = 0; i < indices; ++i) {
+            geometry.indices[i] = indexSize == sizeof(uint16_t) ? static_cast<const uint16_t*>(indexData)[i]
+                : static_cast<const uint32_t*>(indexData)[i];
+        }
+        return geometry;
+    }
+}
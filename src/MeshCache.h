@@ -0,0 +1,238 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <fstream>
+#include <iostream>
+#include <filesystem>
+#include <system_error>
+#include "MappedFile.h"
+#include "MeshBuilder.h"
+
+// Binary cache of the final GPU vertex and index data for an OBJ file (<source>.<format>.jdmesh).
+// A cache file is valid while the source path, size and modification time match and it was
+// built with the same optimization setting (Mesh::optimizeMeshes). When only the modification
+// time differs (fresh checkout, copied files) the content hash is compared instead and the
+// header is refreshed, so the source is hashed at most once.
+namespace MeshCache {
+
+    constexpr char magic[8] = { 'J', 'D', 'M', 'E', 'S', 'H', 0, 0 };
+    constexpr uint32_t version = 6;
+
+    struct Header {
+        char magic[8];
+        uint32_t version;
+        uint32_t vertexFormat;
+        uint64_t pathHash;
+        uint64_t sourceSize;
+        int64_t sourceTime;
+        uint64_t contentHash;
+        uint32_t vertexStride;    // bytes per vertex
+        uint32_t vertexCount;
+        uint32_t indexSize;       // 2 or 4 bytes
+        uint32_t indexCount;
+        uint32_t optimized;       // 1 when the triangles and vertices were reordered for the vertex cache
+        uint32_t reserved;
+        float aabbMin[3];
+        float aabbMax[3];
+        float positionOffset[3];  // VertexQuantization, identity for float formats
+        float positionScale[3];
+        float uvOffset[2];
+        float uvScale[2];
+
+        VertexQuantization quantization() const {
+            VertexQuantization q;
+            q.positionOffset = glm::vec3(positionOffset[0], positionOffset[1], positionOffset[2]);
+            q.positionScale = glm::vec3(positionScale[0], positionScale[1], positionScale[2]);
+            q.uvOffset = glm::vec2(uvOffset[0], uvOffset[1]);
+            q.uvScale = glm::vec2(uvScale[0], uvScale[1]);
+            return q;
+        }
+    };
+    static_assert(sizeof(Header) % 8 == 0, "MeshCache::Header must stay 8 byte aligned");
+
+    // Source file identity, everything except the content hash which is computed lazily
+    struct SourceInfo {
+        std::string path;
+        uint64_t pathHash = 0;
+        uint64_t size = 0;
+        int64_t time = 0;
+    };
+
+    inline uint64_t hashBytes(const void* data, size_t size, uint64_t seed = 0x9E3779B97F4A7C15ull) {
+        const unsigned char* bytes = static_cast<const unsigned char*>(data);
+        uint64_t hash = seed ^ (size * 0xFF51AFD7ED558CCDull);
+        size_t i = 0;
+        for (; i + 8 <= size; i += 8) {
+            uint64_t word;
+            std::memcpy(&word, bytes + i, 8);
+            word *= 0xC4CEB9FE1A85EC53ull;
+            word ^= word >> 31;
+            hash = (hash ^ word) * 0x9E3779B97F4A7C15ull;
+            hash ^= hash >> 29;
+        }
+        uint64_t tail = 0;
+        if (i < size) {
+            std::memcpy(&tail, bytes + i, size - i);
+        }
+        hash = (hash ^ tail) * 0xC4CEB9FE1A85EC53ull;
+        hash ^= hash >> 32;
+        return hash;
+    }
+
+    inline bool querySource(const std::string& path, SourceInfo& info) {
+        std::error_code error;
+        auto size = std::filesystem::file_size(path, error);
+        if (error) {
+            return false;
+        }
+        auto time = std::filesystem::last_write_time(path, error);
+        if (error) {
+            return false;
+        }
+
+        info.path = path;
+        info.pathHash = hashBytes(path.data(), path.size());
+        info.size = static_cast<uint64_t>(size);
+        info.time = static_cast<int64_t>(time.time_since_epoch().count());
+        return true;
+    }
+
+    inline uint64_t hashSource(const std::string& path) {
+        MappedFile file(path);
+        return file.isOpen() ? hashBytes(file.data(), file.size()) : 0;
+    }
+
+    inline std::string cachePath(const std::string& sourcePath, uint32_t vertexFormat) {
+        return sourcePath + "." + std::to_string(vertexFormat) + ".jdmesh";
+    }
+
+    // What gets written, the pointers are only read during store()
+    struct MeshView {
+        uint32_t vertexStride;
+        uint32_t vertexCount;
+        const void* vertexData;
+        uint32_t indexSize;
+        uint32_t indexCount;
+        const void* indexData;
+        const float* aabbMin;
+        const float* aabbMax;
+        VertexQuantization quantization;
+        bool optimized;
+    };
+
+    // Mapped cache file, vertexData() and indexData() point straight into the mapping
+    class Entry {
+    public:
+        const Header& header() const {
+            return *reinterpret_cast<const Header*>(file.data());
+        }
+
+        const void* vertexData() const {
+            return file.data() + sizeof(Header);
+        }
+
+        size_t vertexDataSize() const {
+            return static_cast<size_t>(header().vertexStride) * header().vertexCount;
+        }
+
+        const void* indexData() const {
+            return file.data() + sizeof(Header) + vertexDataSize();
+        }
+
+        size_t indexDataSize() const {
+            return static_cast<size_t>(header().indexSize) * header().indexCount;
+        }
+
+        MappedFile file;
+    };
+
+    inline bool readHeader(const std::string& path, Header& header) {
+        std::ifstream file(path, std::ios::binary);
+        return file.read(reinterpret_cast<char*>(&header), sizeof(Header)) && std::memcmp(header.magic, magic, sizeof(magic)) == 0;
+    }
+
+    // Checks the cache header against the source, refreshing the stored time when only
+    // the timestamp changed but the content is the same
+    inline bool validate(const std::string& path, const Header& header, const SourceInfo& source, uint32_t vertexFormat) {
+        if (std::memcmp(header.magic, magic, sizeof(magic)) != 0 || header.version != version ||
+            header.vertexFormat != vertexFormat || header.pathHash != source.pathHash || header.sourceSize != source.size) {
+            return false;
+        }
+        if (header.sourceTime == source.time) {
+            return true;
+        }
+        if (header.contentHash != hashSource(source.path)) {
+            return false;
+        }
+
+        Header refreshed = header;
+        refreshed.sourceTime = source.time;
+        std::fstream file(path, std::ios::binary | std::ios::in | std::ios::out);
+        if (file) {
+            file.write(reinterpret_cast<const char*>(&refreshed), sizeof(Header));
+        }
+        return true;
+    }
+
+    // Only reads the header, used to get the bounds without mapping the vertex data
+    inline bool peek(const SourceInfo& source, uint32_t vertexFormat, Header& header) {
+        std::string path = cachePath(source.path, vertexFormat);
+        return readHeader(path, header) && validate(path, header, source, vertexFormat);
+    }
+
+    // The bounds from peek() do not depend on the vertex order, the data does, so only load()
+    // checks whether the file was optimized
+    inline bool load(const SourceInfo& source, uint32_t vertexFormat, bool optimized, Entry& entry) {
+        std::string path = cachePath(source.path, vertexFormat);
+        Header header;
+        if (!readHeader(path, header) || !validate(path, header, source, vertexFormat) || header.optimized != (optimized ? 1u : 0u)) {
+            return false;
+        }
+        if (!entry.file.open(path) || entry.file.size() < sizeof(Header) ||
+            entry.file.size() < sizeof(Header) + entry.vertexDataSize() + entry.indexDataSize()) {
+            entry.file.close();
+            return false;
+        }
+        // The header may have been refreshed on disk, re-check the mapped copy
+        return entry.header().vertexCount == header.vertexCount;
+    }
+
+    inline bool store(const SourceInfo& source, uint32_t vertexFormat, const MeshView& mesh) {
+        Header header = {};
+        std::memcpy(header.magic, magic, sizeof(magic));
+        header.version = version;
+        header.vertexFormat = vertexFormat;
+        header.pathHash = source.pathHash;
+        header.sourceSize = source.size;
+        header.sourceTime = source.time;
+        header.contentHash = hashSource(source.path);
+        header.vertexStride = mesh.vertexStride;
+        header.vertexCount = mesh.vertexCount;
+        header.indexSize = mesh.indexSize;
+        header.indexCount = mesh.indexCount;
+        header.optimized = mesh.optimized ? 1u : 0u;
+        std::memcpy(header.aabbMin, mesh.aabbMin, sizeof(header.aabbMin));
+        std::memcpy(header.aabbMax, mesh.aabbMax, sizeof(header.aabbMax));
+        for (int i = 0; i < 3; ++i) {
+            header.positionOffset[i] = mesh.quantization.positionOffset[i];
+            header.positionScale[i] = mesh.quantization.positionScale[i];
+        }
+        for (int i = 0; i < 2; ++i) {
+            header.uvOffset[i] = mesh.quantization.uvOffset[i];
+            header.uvScale[i] = mesh.quantization.uvScale[i];
+        }
+
+        std::string path = cachePath(source.path, vertexFormat);
+        std::ofstream file(path, std::ios::binary | std::ios::trunc);
+        if (!file) {
+            std::cerr << "Failed to write mesh cache: " << path << std::endl;
+            return false;
+        }
+        file.write(reinterpret_cast<const char*>(&header), sizeof(Header));
+        file.write(static_cast<const char*>(mesh.vertexData), static_cast<std::streamsize>(mesh.vertexStride) * mesh.vertexCount);
+        file.write(static_cast<const char*>(mesh.indexData), static_cast<std::streamsize>(mesh.indexSize) * mesh.indexCount);
+        return static_cast<bool>(file);
+    }
+}
@@ -0,0 +1,314 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+#include <cmath>
+#include <string>
+#include <numeric>
+#include <algorithm>
+#include <iostream>
+#include <glm/glm.hpp>
+#include "MeshBuilder.h"
+
+// Triangle and vertex reordering for indexed meshes:
+//  - optimizeVertexCache: Forsyth's linear-speed vertex cache optimisation
+//  - optimizeOverdraw:    splits the cache-ordered list into clusters and sorts them so
+//                         outward facing clusters come first, within an ACMR budget
+//  - optimizeVertexFetch: renumbers vertices in first-use order for linear fetches
+namespace MeshOptimizer {
+
+    struct CacheStats {
+        float acmr = 0.0f; // average cache miss ratio, misses per triangle (0.5 - 3.0)
+        float atvr = 0.0f; // average transformed vertex ratio, misses per vertex (1.0 ideal)
+    };
+
+    // Simulates a FIFO post-transform cache of the given size
+    inline CacheStats analyzeVertexCache(const std::vector<uint32_t>& indices, size_t vertexCount, unsigned cacheSize = 16) {
+        CacheStats stats;
+        if (indices.empty() || vertexCount == 0) {
+            return stats;
+        }
+
+        std::vector<uint32_t> timestamps(vertexCount, 0);
+        uint32_t time = cacheSize + 1;
+        size_t misses = 0;
+
+        for (uint32_t index : indices) {
+            if (time - timestamps[index] > cacheSize) {
+                timestamps[index] = time++;
+                ++misses;
+            }
+        }
+
+        stats.acmr = static_cast<float>(misses) / (indices.size() / 3);
+        stats.atvr = static_cast<float>(misses) / vertexCount;
+        return stats;
+    }
+
+    constexpr unsigned maxCacheSize = 32;
+    constexpr unsigned maxValence = 64;
+
+    // Score tables, filled once so the inner loop does not call pow
+    struct ScoreTables {
+        float cache[maxCacheSize];
+        float valence[maxValence];
+
+        ScoreTables() {
+            for (unsigned i = 0; i < maxCacheSize; ++i) {
+                // The last triangle's vertices get a fixed score so the next one does not just reuse them
+                cache[i] = i < 3 ? 0.75f : std::pow(1.0f - (i - 3) * (1.0f / (maxCacheSize - 3)), 1.5f);
+            }
+            valence[0] = 0.0f;
+            for (unsigned i = 1; i < maxValence; ++i) {
+                // Favour vertices with few triangles left so they get finished and drop out
+                valence[i] = 2.0f * std::pow(static_cast<float>(i), -0.5f);
+            }
+        }
+    };
+
+    inline float vertexScore(int cachePosition, unsigned remainingTriangles) {
+        static const ScoreTables tables;
+        if (remainingTriangles == 0) {
+            return -1.0f;
+        }
+
+        float score = cachePosition >= 0 ? tables.cache[cachePosition] : 0.0f;
+        return score + (remainingTriangles < maxValence
+            ? tables.valence[remainingTriangles]
+            : 2.0f * std::pow(static_cast<float>(remainingTriangles), -0.5f));
+    }
+
+    inline std::vector<uint32_t> optimizeVertexCache(const std::vector<uint32_t>& indices, size_t vertexCount) {
+        const size_t triangleCount = indices.size() / 3;
+        if (triangleCount == 0) {
+            return indices;
+        }
+
+        // Vertex -> triangle adjacency in CSR layout
+        std::vector<uint32_t> triangleOffsets(vertexCount + 1, 0);
+        for (uint32_t index : indices) {
+            ++triangleOffsets[index + 1];
+        }
+        std::partial_sum(triangleOffsets.begin(), triangleOffsets.end(), triangleOffsets.begin());
+
+        std::vector<uint32_t> remaining(vertexCount, 0);
+        std::vector<uint32_t> adjacency(indices.size());
+        for (size_t i = 0; i < indices.size(); ++i) {
+            uint32_t v = indices[i];
+            adjacency[triangleOffsets[v] + remaining[v]++] = static_cast<uint32_t>(i / 3);
+        }
+
+        std::vector<int> cachePosition(vertexCount, -1);
+        std::vector<float> scores(vertexCount);
+        for (size_t v = 0; v < vertexCount; ++v) {
+            scores[v] = vertexScore(-1, remaining[v]);
+        }
+
+        std::vector<float> triangleScores(triangleCount);
+        for (size_t t = 0; t < triangleCount; ++t) {
+            triangleScores[t] = scores[indices[t * 3]] + scores[indices[t * 3 + 1]] + scores[indices[t * 3 + 2]];
+        }
+
+        std::vector<bool> emitted(triangleCount, false);
+        std::vector<uint32_t> result;
+        result.reserve(indices.size());
+
+        uint32_t cache[maxCacheSize + 3];
+        unsigned cacheCount = 0;
+        size_t fallbackCursor = 0;
+
+        int bestTriangle = 0;
+        for (size_t t = 1; t < triangleCount; ++t) {
+            if (triangleScores[t] > triangleScores[bestTriangle]) {
+                bestTriangle = static_cast<int>(t);
+            }
+        }
+
+        while (bestTriangle >= 0) {
+            const uint32_t* tri = &indices[bestTriangle * 3];
+            emitted[bestTriangle] = true;
+            result.insert(result.end(), tri, tri + 3);
+
+            // Move the triangle's vertices to the front of the LRU cache
+            uint32_t newCache[maxCacheSize + 3];
+            unsigned newCount = 0;
+            for (int i = 0; i < 3; ++i) {
+                newCache[newCount++] = tri[i];
+            }
+            for (unsigned i = 0; i < cacheCount; ++i) {
+                uint32_t v = cache[i];
+                if (v != tri[0] && v != tri[1] && v != tri[2]) {
+                    newCache[newCount++] = v;
+                }
+            }
+
+            // Drop the emitted triangle from its vertices' adjacency lists
+            for (int i = 0; i < 3; ++i) {
+                uint32_t v = tri[i];
+                uint32_t* begin = &adjacency[triangleOffsets[v]];
+                uint32_t* end = begin + remaining[v];
+                uint32_t* found = std::find(begin, end, static_cast<uint32_t>(bestTriangle));
+                if (found != end) {
+                    std::swap(*found, *(end - 1));
+                    --remaining[v];
+                }
+            }
+
+            // Rescore the cache contents (and whatever just fell out) and their triangles
+            for (unsigned i = 0; i < newCount; ++i) {
+                uint32_t v = newCache[i];
+                cachePosition[v] = i < maxCacheSize ? static_cast<int>(i) : -1;
+                float newScore = vertexScore(cachePosition[v], remaining[v]);
+                float delta = newScore - scores[v];
+                scores[v] = newScore;
+
+                const uint32_t* adjacent = &adjacency[triangleOffsets[v]];
+                for (uint32_t k = 0; k < remaining[v]; ++k) {
+                    triangleScores[adjacent[k]] += delta;
+                }
+            }
+
+            cacheCount = std::min(newCount, maxCacheSize);
+            std::copy(newCache, newCache + cacheCount, cache);
+
+            // The next triangle is the best one touching the cache
+            bestTriangle = -1;
+            float bestScore = -1.0f;
+            for (unsigned i = 0; i < cacheCount; ++i) {
+                uint32_t v = cache[i];
+                const uint32_t* adjacent = &adjacency[triangleOffsets[v]];
+                for (uint32_t k = 0; k < remaining[v]; ++k) {
+                    uint32_t t = adjacent[k];
+                    if (triangleScores[t] > bestScore) {
+                        bestScore = triangleScores[t];
+                        bestTriangle = static_cast<int>(t);
+                    }
+                }
+            }
+
+            // Nothing adjacent left, continue with the next unemitted triangle in input order
+            if (bestTriangle < 0) {
+                while (fallbackCursor < triangleCount && emitted[fallbackCursor]) {
+                    ++fallbackCursor;
+                }
+                if (fallbackCursor < triangleCount) {
+                    bestTriangle = static_cast<int>(fallbackCursor);
+                }
+            }
+        }
+
+        return result;
+    }
+
+    // Reorders whole clusters of the cache optimised list front to back from the outside in.
+    // A cluster ends wherever the FIFO cache is fully missed, so the vertex cache efficiency
+    // stays close to the input; the result is discarded if ACMR grows beyond the threshold.
+    inline std::vector<uint32_t> optimizeOverdraw(const std::vector<uint32_t>& indices, const std::vector<float>& vertexData,
+        size_t stride, unsigned cacheSize = 16, float threshold = 1.05f) {
+        const size_t triangleCount = indices.size() / 3;
+        const size_t vertexCount = vertexData.size() / stride;
+        if (triangleCount < 2) {
+            return indices;
+        }
+
+        // Split into clusters at hard cache boundaries
+        std::vector<size_t> clusters;
+        std::vector<uint32_t> timestamps(vertexCount, 0);
+        uint32_t time = cacheSize + 1;
+        for (size_t t = 0; t < triangleCount; ++t) {
+            unsigned misses = 0;
+            for (int i = 0; i < 3; ++i) {
+                uint32_t v = indices[t * 3 + i];
+                if (time - timestamps[v] > cacheSize) {
+                    timestamps[v] = time++;
+                    ++misses;
+                }
+            }
+            if (t == 0 || misses == 3) {
+                clusters.push_back(t);
+            }
+        }
+        clusters.push_back(triangleCount);
+
+        auto position = [&](uint32_t v) {
+            return glm::vec3(vertexData[v * stride], vertexData[v * stride + 1], vertexData[v * stride + 2]);
+        };
+
+        glm::vec3 meshCentroid(0.0f);
+        for (size_t v = 0; v < vertexCount; ++v) {
+            meshCentroid += position(static_cast<uint32_t>(v));
+        }
+        meshCentroid /= static_cast<float>(std::max<size_t>(vertexCount, 1));
+
+        // Sort key: how far the cluster faces away from the mesh centre
+        std::vector<float> sortKeys(clusters.size() - 1);
+        for (size_t c = 0; c + 1 < clusters.size(); ++c) {
+            glm::vec3 centroid(0.0f), normal(0.0f);
+            float area = 0.0f;
+            for (size_t t = clusters[c]; t < clusters[c + 1]; ++t) {
+                glm::vec3 p0 = position(indices[t * 3]);
+                glm::vec3 p1 = position(indices[t * 3 + 1]);
+                glm::vec3 p2 = position(indices[t * 3 + 2]);
+                glm::vec3 n = glm::cross(p1 - p0, p2 - p0);
+                float triangleArea = glm::length(n);
+                centroid += (p0 + p1 + p2) * (triangleArea / 3.0f);
+                normal += n;
+                area += triangleArea;
+            }
+            centroid = area > 0.0f ? centroid / area : centroid;
+            float normalLength = glm::length(normal);
+            normal = normalLength > 0.0f ? normal / normalLength : normal;
+            sortKeys[c] = glm::dot(centroid - meshCentroid, normal);
+        }
+
+        std::vector<size_t> order(sortKeys.size());
+        std::iota(order.begin(), order.end(), 0);
+        std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+            return sortKeys[a] > sortKeys[b];
+        });
+
+        std::vector<uint32_t> result;
+        result.reserve(indices.size());
+        for (size_t c : order) {
+            result.insert(result.end(), indices.begin() + clusters[c] * 3, indices.begin() + clusters[c + 1] * 3);
+        }
+
+        float before = analyzeVertexCache(indices, vertexCount, cacheSize).acmr;
+        float after = analyzeVertexCache(result, vertexCount, cacheSize).acmr;
+        return after <= before * threshold ? result : indices;
+    }
+
+    // Renumbers vertices in the order the index buffer first touches them
+    inline void optimizeVertexFetch(std::vector<float>& vertexData, size_t stride, std::vector<uint32_t>& indices) {
+        const size_t vertexCount = vertexData.size() / stride;
+        const uint32_t unused = 0xFFFFFFFFu;
+        std::vector<uint32_t> remap(vertexCount, unused);
+        std::vector<float> reordered;
+        reordered.reserve(vertexData.size());
+
+        uint32_t next = 0;
+        for (uint32_t& index : indices) {
+            if (remap[index] == unused) {
+                remap[index] = next++;
+                reordered.insert(reordered.end(), vertexData.begin() + index * stride, vertexData.begin() + (index + 1) * stride);
+            }
+            index = remap[index];
+        }
+
+        // Vertices no index refers to are dropped
+        vertexData.swap(reordered);
+    }
+
+    inline void optimize(const std::string& name, IndexedMesh& mesh, unsigned cacheSize = 16) {
+        const size_t stride = floatsPerVertex(mesh.format);
+        CacheStats before = analyzeVertexCache(mesh.indices, mesh.vertexCount(), cacheSize);
+
+        mesh.indices = optimizeVertexCache(mesh.indices, mesh.vertexCount());
+        mesh.indices = optimizeOverdraw(mesh.indices, mesh.vertexData, stride, cacheSize);
+        optimizeVertexFetch(mesh.vertexData, stride, mesh.indices);
+
+        CacheStats after = analyzeVertexCache(mesh.indices, mesh.vertexCount(), cacheSize);
+        std::cout << "Optimized " << name << ": ACMR " << before.acmr << " -> " << after.acmr
+            << ", ATVR " << before.atvr << " -> " << after.atvr << " (FIFO " << cacheSize << ")" << std::endl;
+    }
+}
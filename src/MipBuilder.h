@@ -0,0 +1,268 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+#include "DecodedImage.h"
+
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#include <xmmintrin.h>
+#define MIPBUILDER_SSE 1
+#endif
+
+enum TextureUsage
+{
+    ColorTexture = 0,
+    NormalTexture = 1,
+    HeightTexture = 2
+};
+
+// Builds mip chains on the CPU. Filtering runs on float RGBA in linear space: color is
+// converted from sRGB first, normal maps are filtered as vectors and renormalized, height
+// maps are filtered as stored. Every level is returned as RGBA8.
+namespace MipBuilder {
+
+    enum Filter {
+        BoxFilter = 0,
+        KaiserFilter = 1
+    };
+
+    struct Level {
+        int width;
+        int height;
+        std::vector<uint8_t> pixels;
+    };
+
+    inline const float* srgbToLinearTable() {
+        static const std::vector<float> table = [] {
+            std::vector<float> values(256);
+            for (int i = 0; i < 256; ++i) {
+                float c = i / 255.0f;
+                values[i] = c <= 0.04045f ? c / 12.92f : std::pow((c + 0.055f) / 1.055f, 2.4f);
+            }
+            return values;
+        }();
+        return table.data();
+    }
+
+    inline uint8_t linearToSrgb(float c) {
+        c = std::clamp(c, 0.0f, 1.0f);
+        float s = c <= 0.0031308f ? c * 12.92f : 1.055f * std::pow(c, 1.0f / 2.4f) - 0.055f;
+        return static_cast<uint8_t>(s * 255.0f + 0.5f);
+    }
+
+    inline uint8_t unorm8(float c) {
+        return static_cast<uint8_t>(std::clamp(c, 0.0f, 1.0f) * 255.0f + 0.5f);
+    }
+
+    // Zeroth order modified Bessel function for the Kaiser window
+    inline double besselI0(double x) {
+        double sum = 1.0, term = 1.0;
+        for (int k = 1; k < 32; ++k) {
+            term *= (x / (2.0 * k)) * (x / (2.0 * k));
+            sum += term;
+            if (term < sum * 1e-12) {
+                break;
+            }
+        }
+        return sum;
+    }
+
+    // Kaiser windowed sinc, x in destination texels, 3 texels wide with alpha 4
+    inline float kaiser(float x) {
+        constexpr float width = 3.0f, alpha = 4.0f;
+        float t = x / (width * 0.5f);
+        if (std::fabs(t) >= 1.0f) {
+            return 0.0f;
+        }
+        float sinc = x == 0.0f ? 1.0f : std::sin(3.14159265f * x) / (3.14159265f * x);
+        return sinc * static_cast<float>(besselI0(alpha * std::sqrt(1.0 - t * t)) / besselI0(alpha));
+    }
+
+    struct Tap {
+        int source;
+        float weight;
+    };
+
+    // Source taps of every destination texel along one axis, edges clamp
+    inline std::vector<std::vector<Tap>> buildTaps(int sourceSize, int destinationSize, Filter filter) {
+        std::vector<std::vector<Tap>> taps(destinationSize);
+        float scale = static_cast<float>(sourceSize) / destinationSize;
+
+        for (int x = 0; x < destinationSize; ++x) {
+            float begin = x * scale, end = (x + 1) * scale;
+            std::vector<Tap>& list = taps[x];
+            float total = 0.0f;
+
+            if (filter == BoxFilter) {
+                for (int i = static_cast<int>(begin); i < static_cast<int>(std::ceil(end)); ++i) {
+                    float weight = std::min(end, i + 1.0f) - std::max(begin, static_cast<float>(i));
+                    if (weight > 0.0f) {
+                        list.push_back({ std::min(i, sourceSize - 1), weight });
+                        total += weight;
+                    }
+                }
+            }
+            else {
+                float center = (begin + end) * 0.5f;
+                float radius = 1.5f * scale;
+                for (int i = static_cast<int>(std::floor(center - radius)); i <= static_cast<int>(std::ceil(center + radius)); ++i) {
+                    float weight = kaiser((i + 0.5f - center) / scale);
+                    if (weight != 0.0f) {
+                        list.push_back({ std::clamp(i, 0, sourceSize - 1), weight });
+                        total += weight;
+                    }
+                }
+            }
+
+            for (Tap& tap : list) {
+                tap.weight /= total;
+            }
+        }
+        return taps;
+    }
+
+    // accumulator += weight * pixel on four channels
+    inline void accumulate(float* accumulator, const float* pixel, float weight) {
+#ifdef MIPBUILDER_SSE
+        __m128 sum = _mm_loadu_ps(accumulator);
+        sum = _mm_add_ps(sum, _mm_mul_ps(_mm_set1_ps(weight), _mm_loadu_ps(pixel)));
+        _mm_storeu_ps(accumulator, sum);
+#else
+        for (int c = 0; c < 4; ++c) {
+            accumulator[c] += weight * pixel[c];
+        }
+#endif
+    }
+
+    // Separable resample of a float RGBA image, horizontal pass first
+    inline std::vector<float> downsample(const std::vector<float>& source, int width, int height, int nextWidth, int nextHeight, Filter filter) {
+        std::vector<std::vector<Tap>> horizontal = buildTaps(width, nextWidth, filter);
+        std::vector<std::vector<Tap>> vertical = buildTaps(height, nextHeight, filter);
+
+        std::vector<float> rows(static_cast<size_t>(nextWidth) * height * 4, 0.0f);
+        for (int y = 0; y < height; ++y) {
+            const float* sourceRow = source.data() + static_cast<size_t>(y) * width * 4;
+            float* row = rows.data() + static_cast<size_t>(y) * nextWidth * 4;
+            for (int x = 0; x < nextWidth; ++x) {
+                for (const Tap& tap : horizontal[x]) {
+                    accumulate(row + x * 4, sourceRow + tap.source * 4, tap.weight);
+                }
+            }
+        }
+
+        std::vector<float> result(static_cast<size_t>(nextWidth) * nextHeight * 4, 0.0f);
+        for (int y = 0; y < nextHeight; ++y) {
+            float* row = result.data() + static_cast<size_t>(y) * nextWidth * 4;
+            for (const Tap& tap : vertical[y]) {
+                const float* sourceRow = rows.data() + static_cast<size_t>(tap.source) * nextWidth * 4;
+                for (int x = 0; x < nextWidth; ++x) {
+                    accumulate(row + x * 4, sourceRow + x * 4, tap.weight);
+                }
+            }
+        }
+        return result;
+    }
+
+    inline std::vector<float> toLinear(const DecodedImage& image, TextureUsage usage) {
+        const float* srgb = srgbToLinearTable();
+        size_t count = static_cast<size_t>(image.width) * image.height;
+        std::vector<float> pixels(count * 4);
+        const uint8_t* source = image.pixels.get();
+
+        for (size_t i = 0; i < count; ++i) {
+            const uint8_t* pixel = source + i * image.nrChannels;
+            float* out = pixels.data() + i * 4;
+            for (int c = 0; c < 3; ++c) {
+                if (usage == ColorTexture) {
+                    out[c] = srgb[pixel[c]];
+                }
+                else if (usage == NormalTexture) {
+                    out[c] = pixel[c] / 255.0f * 2.0f - 1.0f;
+                }
+                else {
+                    out[c] = pixel[c] / 255.0f;
+                }
+            }
+            out[3] = image.nrChannels == 4 ? pixel[3] / 255.0f : 1.0f;
+        }
+        return pixels;
+    }
+
+    inline std::vector<uint8_t> fromLinear(const std::vector<float>& pixels, TextureUsage usage) {
+        size_t count = pixels.size() / 4;
+        std::vector<uint8_t> result(count * 4);
+
+        for (size_t i = 0; i < count; ++i) {
+            const float* pixel = pixels.data() + i * 4;
+            uint8_t* out = result.data() + i * 4;
+            if (usage == ColorTexture) {
+                for (int c = 0; c < 3; ++c) {
+                    out[c] = linearToSrgb(pixel[c]);
+                }
+            }
+            else if (usage == NormalTexture) {
+                // Averaged normals get shorter, push them back onto the unit sphere
+                float length = std::sqrt(pixel[0] * pixel[0] + pixel[1] * pixel[1] + pixel[2] * pixel[2]);
+                float normal[3] = { 0.0f, 0.0f, 1.0f };
+                if (length > 1e-6f) {
+                    for (int c = 0; c < 3; ++c) {
+                        normal[c] = pixel[c] / length;
+                    }
+                }
+                for (int c = 0; c < 3; ++c) {
+                    out[c] = unorm8(normal[c] * 0.5f + 0.5f);
+                }
+            }
+            else {
+                for (int c = 0; c < 3; ++c) {
+                    out[c] = unorm8(pixel[c]);
+                }
+            }
+            out[3] = unorm8(pixel[3]);
+        }
+        return result;
+    }
+
+    inline std::vector<uint8_t> expandToRGBA(const DecodedImage& image) {
+        size_t count = static_cast<size_t>(image.width) * image.height;
+        std::vector<uint8_t> pixels(count * 4);
+        for (size_t i = 0; i < count; ++i) {
+            const uint8_t* pixel = image.pixels.get() + i * image.nrChannels;
+            pixels[i * 4 + 0] = pixel[0];
+            pixels[i * 4 + 1] = pixel[1];
+            pixels[i * 4 + 2] = pixel[2];
+            pixels[i * 4 + 3] = image.nrChannels == 4 ? pixel[3] : 255;
+        }
+        return pixels;
+    }
+
+    // Full chain down to 1x1. Levels larger than maxSize (0 = no limit) are filtered but not
+    // returned, so the first level is the largest one the quality tier allows.
+    inline std::vector<Level> build(const DecodedImage& image, TextureUsage usage, Filter filter, int maxSize = 0) {
+        std::vector<Level> levels;
+        int width = image.width, height = image.height;
+        auto fits = [maxSize](int w, int h) {
+            return maxSize <= 0 || (w <= maxSize && h <= maxSize);
+        };
+
+        // The top level is kept bit exact when it is not capped
+        if (fits(width, height)) {
+            levels.push_back({ width, height, expandToRGBA(image) });
+        }
+
+        std::vector<float> current = toLinear(image, usage);
+        while (width > 1 || height > 1) {
+            int nextWidth = std::max(1, width / 2), nextHeight = std::max(1, height / 2);
+            current = downsample(current, width, height, nextWidth, nextHeight, filter);
+            width = nextWidth;
+            height = nextHeight;
+
+            if (fits(width, height)) {
+                levels.push_back({ width, height, fromLinear(current, usage) });
+            }
+        }
+        return levels;
+    }
+}
@@ -8,26 +8,14 @@
 #include <sstream>
 #include <memory>
 #include "Texture.h"
+#include "TextureManager.h"
+#include "TextureArray.h"
+#include "Mesh.h"
+#include "InstanceBuffer.h"
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtc/type_ptr.hpp>
 
-struct Vertex {
-    float x, y, z;
-};
-
-struct TexCoord {
-    float u, v;
-};
-
-struct Normal {
-    float x, y, z;
-};
-
-struct Face {
-    int v[3], t[3], n[3];
-};
-
 enum ModelType
 {
     Colored = 0,
@@ -36,23 +24,58 @@ enum ModelType
     Parallax = 3
 };
 
-struct AABB {
-    glm::vec3 min;
-    glm::vec3 max;
+// Uniforms set for every draw, hashed at compile time
+namespace ModelUniforms {
+    constexpr UniformId transform("transform");
+    constexpr UniformId materialIndex("materialIndex");
+    constexpr UniformId heightScale("heightScale");
+    constexpr UniformId compactVertices("compactVertices");
+    constexpr UniformId positionOffset("positionOffset");
+    constexpr UniformId positionScale("positionScale");
+    constexpr UniformId uvOffset("uvOffset");
+    constexpr UniformId uvScale("uvScale");
+    constexpr UniformId textureLayers[3] = { UniformId("textureLayer1"), UniformId("textureLayer2"), UniformId("textureLayer3") };
+}
+
+// ModelUniforms of one program, see Shader::uniformSet. The model shaders only declare what
+// their variant uses, so missing ones resolve quietly to -1.
+struct ModelUniformHandles {
+    Uniform<glm::mat4> transform;
+    Uniform<int> materialIndex;
+    Uniform<float> heightScale;
+    Uniform<bool> compactVertices;
+    Uniform<glm::vec3> positionOffset;
+    Uniform<glm::vec3> positionScale;
+    Uniform<glm::vec2> uvOffset;
+    Uniform<glm::vec2> uvScale;
+    Uniform<int> textureLayers[3];
+
+    explicit ModelUniformHandles(const Shader& shader)
+        : transform(shader.optionalUniform<glm::mat4>(ModelUniforms::transform)),
+        materialIndex(shader.optionalUniform<int>(ModelUniforms::materialIndex)),
+        heightScale(shader.optionalUniform<float>(ModelUniforms::heightScale)),
+        compactVertices(shader.optionalUniform<bool>(ModelUniforms::compactVertices)),
+        positionOffset(shader.optionalUniform<glm::vec3>(ModelUniforms::positionOffset)),
+        positionScale(shader.optionalUniform<glm::vec3>(ModelUniforms::positionScale)),
+        uvOffset(shader.optionalUniform<glm::vec2>(ModelUniforms::uvOffset)),
+        uvScale(shader.optionalUniform<glm::vec2>(ModelUniforms::uvScale)) {
+        for (int slot = 0; slot < 3; ++slot) {
+            textureLayers[slot] = shader.optionalUniform<int>(ModelUniforms::textureLayers[slot]);
+        }
+    }
 };
 
-
 class Model {
 public:
-    std::vector<Vertex> vertices;
-    std::vector<TexCoord> texCoords;
-    std::vector<Normal> normals;
-    std::vector<Face> faces;
-    GLuint VAO = 0, VBO = 0;
+    std::shared_ptr<Mesh> mesh;
+    std::string meshPath;
     std::shared_ptr<Texture> texture0 = nullptr; 
     std::shared_ptr<Texture> texture1 = nullptr;
     std::shared_ptr<Texture> texture2 = nullptr;
-    ModelType modelType;
+    std::string texturePaths[3];
+    int textureLayers[3] = { -1, -1, -1 };  // layer in the slot's TextureArray once packed
+    ModelType modelType = Colored;
+    int materialIndex = 0;  // entry of the Materials uniform block
 
     glm::vec3 position = glm::vec3(0.0f); // Position of the model
     glm::vec3 rotation = glm::vec3(0.0f); // Rotation (in degrees)
@@ -63,93 +86,47 @@ public:
     Model() = default;
 
     bool loadFromFile(const std::string& filename) {
-        std::ifstream file(filename);
-        if (!file.is_open()) {
-            std::cerr << "Failed to open OBJ file: " << filename << std::endl;
+        meshPath = filename;
+        mesh = MeshRegistry::instance().acquire(filename, vertexFormat());
+        if (!mesh) {
             return false;
         }
-
-        std::cout << "Loading model from file: " << filename << std::endl;
-
-        std::string line;
-        while (std::getline(file, line)) {
-            std::istringstream ss(line);
-            std::string prefix;
-            ss >> prefix;
-
-            if (prefix == "v") {
-                Vertex v;
-                ss >> v.x >> v.y >> v.z;
-                vertices.push_back(v);
-            }
-            else if (prefix == "vt") {
-                TexCoord tc;
-                ss >> tc.u >> tc.v;
-                texCoords.push_back(tc);
-            }
-            else if (prefix == "vn") {
-                Normal n;
-                ss >> n.x >> n.y >> n.z;
-                normals.push_back(n);
-            }
-            else if (prefix == "f") {
-                Face f = {};
-                for (int i = 0; i < 3; ++i) {
-                    std::string vertexData;
-                    ss >> vertexData;
-
-                    std::istringstream vertexStream(vertexData);
-                    std::string index;
-
-                    if (std::getline(vertexStream, index, '/')) {
-                        f.v[i] = std::stoi(index) - 1;
-                    }
-
-                    if (std::getline(vertexStream, index, '/')) {
-                        f.t[i] = !index.empty() ? std::stoi(index) - 1 : -1;
-                    }
-
-                    if (std::getline(vertexStream, index)) {
-                        f.n[i] = !index.empty() ? std::stoi(index) - 1 : -1;
-                    }
-                }
-                faces.push_back(f);
-            }
-        }
-
-        file.close();
-       // setupBuffers();
-        calculateAABB();
-       
-
+        aabb = mesh->aabb;
+        worldBoundsValid = false;
         return true;
     }
 
-    void calculateAABB() {
-        glm::vec3 min = glm::vec3(std::numeric_limits<float>::max());
-        glm::vec3 max = glm::vec3(std::numeric_limits<float>::lowest());
-
-        // Calculate local-space AABB
-        for (const auto& vertex : vertices) {
-            min.x = std::min(min.x, vertex.x);
-            min.y = std::min(min.y, vertex.y);
-            min.z = std::min(min.z, vertex.z);
-
-            max.x = std::max(max.x, vertex.x);
-            max.y = std::max(max.y, vertex.y);
-            max.z = std::max(max.z, vertex.z);
+    VertexFormat vertexFormat() const {
+        if (modelType == Parallax) {
+            return Mesh::compactVertices ? CompactTangentVertices : TangentVertices;
         }
-
-        aabb = { min, max };
+        return Mesh::compactVertices ? CompactVertices : StandardVertices;
     }
 
-    AABB getTransformedAABB() const {
+    glm::mat4 getModelMatrix() const {
         glm::mat4 modelMatrix = glm::mat4(1.0f);
         modelMatrix = glm::translate(modelMatrix, position);
         modelMatrix = glm::rotate(modelMatrix, glm::radians(rotation.x), glm::vec3(1.0f, 0.0f, 0.0f));
         modelMatrix = glm::rotate(modelMatrix, glm::radians(rotation.y), glm::vec3(0.0f, 1.0f, 0.0f));
         modelMatrix = glm::rotate(modelMatrix, glm::radians(rotation.z), glm::vec3(0.0f, 0.0f, 1.0f));
         modelMatrix = glm::scale(modelMatrix, scale);
+        return modelMatrix;
+    }
+
+    // getTransformedAABB() cached, recomputed only after position, rotation or scale changed
+    const AABB& getWorldAABB() const {
+        if (!worldBoundsValid || position != boundsPosition || rotation != boundsRotation || scale != boundsScale) {
+            worldBounds = getTransformedAABB();
+            boundsPosition = position;
+            boundsRotation = rotation;
+            boundsScale = scale;
+            worldBoundsValid = true;
+        }
+        return worldBounds;
+    }
+
+    AABB getTransformedAABB() const {
+        glm::mat4 modelMatrix = getModelMatrix();
 
         // Compute all 8 vertices of the local-space AABB
         glm::vec3 vertices[8] = {
@@ -177,281 +154,119 @@ public:
     }
 
     void setupBuffers() {
-
-        if (modelType == Parallax)
-        {
-
-            std::cout << "Setting up buffers... Parallax" << std::endl;
-
-            std::vector<float> vertexData;
-            for (const auto& face : faces) {
-                glm::vec3 pos[3];
-                glm::vec2 tex[3];
-
-                // Pobranie pozycji i wsprzdnych tekstur dla trjkta
-                for (int i = 0; i < 3; ++i) {
-                    pos[i] = glm::vec3(vertices[face.v[i]].x, vertices[face.v[i]].y, vertices[face.v[i]].z);
-                    tex[i] = face.t[i] >= 0 && static_cast<size_t>(face.t[i]) < texCoords.size()
-                        ? glm::vec2(texCoords[face.t[i]].u, texCoords[face.t[i]].v)
-                        : glm::vec2(0.0f);
-                }
-
-                // Obliczanie tangentw i bitangentw
-                glm::vec3 edge1 = pos[1] - pos[0];
-                glm::vec3 edge2 = pos[2] - pos[0];
-                glm::vec2 deltaUV1 = tex[1] - tex[0];
-                glm::vec2 deltaUV2 = tex[2] - tex[0];
-
-                float f = 1.0f / (deltaUV1.x * deltaUV2.y - deltaUV2.x * deltaUV1.y);
-                glm::vec3 tangent = f * (deltaUV2.y * edge1 - deltaUV1.y * edge2);
-                glm::vec3 bitangent = f * (-deltaUV2.x * edge1 + deltaUV1.x * edge2);
-
-                // Normalizacja tangentw i bitangentw
-                tangent = glm::normalize(tangent);
-                bitangent = glm::normalize(bitangent);
-
-                // Dodawanie danych wierzchokowych
-                for (int i = 0; i < 3; ++i) {
-                    const auto& v = vertices[face.v[i]];
-                    vertexData.push_back(v.x);
-                    vertexData.push_back(v.y);
-                    vertexData.push_back(v.z);
-
-                    if (face.t[i] >= 0 && static_cast<size_t>(face.t[i]) < texCoords.size()) {
-                        const auto& tc = texCoords[face.t[i]];
-                        vertexData.push_back(tc.u);
-                        vertexData.push_back(tc.v);
-                    }
-                    else {
-                        vertexData.push_back(0.0f);
-                        vertexData.push_back(0.0f);
-                    }
-
-                    if (face.n[i] >= 0 && static_cast<size_t>(face.n[i]) < normals.size()) {
-                        const auto& n = normals[face.n[i]];
-                        vertexData.push_back(n.x);
-                        vertexData.push_back(n.y);
-                        vertexData.push_back(n.z);
-                    }
-                    else {
-                        vertexData.push_back(0.0f);
-                        vertexData.push_back(0.0f);
-                        vertexData.push_back(0.0f);
-                    }
-
-                    // Tangent i Bitangent
-                    vertexData.push_back(tangent.x);
-                    vertexData.push_back(tangent.y);
-                    vertexData.push_back(tangent.z);
-
-                    vertexData.push_back(bitangent.x);
-                    vertexData.push_back(bitangent.y);
-                    vertexData.push_back(bitangent.z);
-                }
+        if (!mesh) {
+            return;
+        }
+        // Textures assigned after loadFromFile can change the vertex format (Parallax needs tangents)
+        if (mesh->format != vertexFormat()) {
+            std::shared_ptr<Mesh> other = MeshRegistry::instance().acquire(meshPath, vertexFormat());
+            if (!other) {
+                return;
             }
-
-            glGenVertexArrays(1, &VAO);
-            glGenBuffers(1, &VBO);
-
-            glBindVertexArray(VAO);
-
-            glBindBuffer(GL_ARRAY_BUFFER, VBO);
-            glBufferData(GL_ARRAY_BUFFER, vertexData.size() * sizeof(float), vertexData.data(), GL_STATIC_DRAW);
-
-            // Pozycja wierzchoka
-            glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 14 * sizeof(float), (void*)0);
-            glEnableVertexAttribArray(0);
-
-            // Wsprzdne tekstur
-            glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 14 * sizeof(float), (void*)(3 * sizeof(float)));
-            glEnableVertexAttribArray(1);
-
-            // Normalny
-            glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, 14 * sizeof(float), (void*)(5 * sizeof(float)));
-            glEnableVertexAttribArray(2);
-
-            // Tangenty
-            glVertexAttribPointer(3, 3, GL_FLOAT, GL_FALSE, 14 * sizeof(float), (void*)(8 * sizeof(float)));
-            glEnableVertexAttribArray(3);
-
-            // Bitangenty
-            glVertexAttribPointer(4, 3, GL_FLOAT, GL_FALSE, 14 * sizeof(float), (void*)(11 * sizeof(float)));
-            glEnableVertexAttribArray(4);
-
-            glBindVertexArray(0);
-
-            std::cout << "Buffers setup complete." << std::endl;
-            
-
-            
+            mesh = std::move(other);
         }
-        else
-        {
-
- 
-
-        std::cout << "Setting up buffers..." << std::endl;
-
-        std::vector<float> vertexData;
-        for (const auto& face : faces) {
-            for (int i = 0; i < 3; ++i) {
-                const auto& v = vertices[face.v[i]];
-                vertexData.push_back(v.x);
-                vertexData.push_back(v.y);
-                vertexData.push_back(v.z);
-
-                if (face.t[i] >= 0 && static_cast<size_t>(face.t[i]) < texCoords.size()) {  // Cast to size_t
-                    const auto& tc = texCoords[face.t[i]];
-                    vertexData.push_back(tc.u);
-                    vertexData.push_back(tc.v);
-                }
-                else {
-                    vertexData.push_back(0.0f);
-                    vertexData.push_back(0.0f);
-                }
-
-                if (face.n[i] >= 0 && static_cast<size_t>(face.n[i]) < normals.size()) {  // Cast to size_t
-                    const auto& n = normals[face.n[i]];
-                    vertexData.push_back(n.x);
-                    vertexData.push_back(n.y);
-                    vertexData.push_back(n.z);
-                }
-                else {
-                    vertexData.push_back(0.0f);
-                    vertexData.push_back(0.0f);
-                    vertexData.push_back(0.0f);
-                }
+        mesh->upload();
+    }
 
+    // The texture objects render() binds, 21 bits per slot, for sorting draws by texture set
+    uint64_t textureState() const {
+        const std::shared_ptr<Texture>* textures[3] = { &texture0, &texture1, &texture2 };
+        uint64_t state = 0;
+        for (int slot = 0; slot < 3; ++slot) {
+            const std::shared_ptr<Texture>& texture = *textures[slot];
+            uint64_t id = 0;
+            if (texture && texture->isLoaded) {
+                id = texture->array ? texture->array->ID : texture->ID;
             }
+            state |= (id & 0x1FFFFFu) << (21 * slot);
         }
-
-        glGenVertexArrays(1, &VAO);
-        glGenBuffers(1, &VBO);
-
-        glBindVertexArray(VAO);
-
-        glBindBuffer(GL_ARRAY_BUFFER, VBO);
-        glBufferData(GL_ARRAY_BUFFER, vertexData.size() * sizeof(float), vertexData.data(), GL_STATIC_DRAW);
-
-        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)0);
-        glEnableVertexAttribArray(0);
-
-        glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)(3 * sizeof(float)));
-        glEnableVertexAttribArray(1);
-
-        glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)(5 * sizeof(float)));
-        glEnableVertexAttribArray(2);
-
-        glBindVertexArray(0);
-
-        std::cout << "Buffers setup complete." << std::endl;
-       }
-
-
+        return state;
     }
 
-    void render(std::shared_ptr<Shader> shaderProgram, glm::vec3 viewPos) const {
-        glm::mat4 modelMatrix = glm::mat4(1.0f);
-        modelMatrix = glm::translate(modelMatrix, position);
-        modelMatrix = glm::rotate(modelMatrix, glm::radians(rotation.x), glm::vec3(1.0f, 0.0f, 0.0f));
-        modelMatrix = glm::rotate(modelMatrix, glm::radians(rotation.y), glm::vec3(0.0f, 1.0f, 0.0f));
-        modelMatrix = glm::rotate(modelMatrix, glm::radians(rotation.z), glm::vec3(0.0f, 0.0f, 1.0f));
-        modelMatrix = glm::scale(modelMatrix, scale);
-
-        shaderProgram->setMat4("transform", modelMatrix);
-
-        if (modelType == Colored || modelType == Textured || modelType == Parallax || modelType == DoubleTextured)
-        {
-            //glm::vec3 lightColor = glm::vec3(0.4f, 0.8f,0.6f);
-           /* lightColor.x = static_cast<float>(sin(glfwGetTime() * 2.0));
-            lightColor.y = static_cast<float>(sin(glfwGetTime() * 0.7));
-            lightColor.z = static_cast<float>(sin(glfwGetTime() * 1.3));*/
-
-            float distance = 4.f;
-
-            glm::vec3 lightColor = glm::vec3(1.0f, 0.0f, 0.0f);
-            glm::vec3 diffuseColor = lightColor * glm::vec3(0.5f); // decrease the influence
-            glm::vec3 ambientColor = diffuseColor * glm::vec3(0.2f);
-
-            shaderProgram->setVec3("viewPos", viewPos);
-
-
-            shaderProgram->setVec3("light[0].position", distance, 2.0f, distance);
-            shaderProgram->setVec3("light[0].ambient", ambientColor);
-            shaderProgram->setVec3("light[0].diffuse", diffuseColor);
-            shaderProgram->setVec3("light[0].specular", 1.0f, 1.0f, 1.0f);
-
-            lightColor = glm::vec3(0.0f, 1.0f, 0.0f);
-            diffuseColor = lightColor * glm::vec3(0.5f); 
-            ambientColor = diffuseColor * glm::vec3(0.2f);
-
-
-            shaderProgram->setVec3("light[1].position", -distance, 2.0f, distance);
-            shaderProgram->setVec3("light[1].ambient", ambientColor);
-            shaderProgram->setVec3("light[1].diffuse", diffuseColor);
-            shaderProgram->setVec3("light[1].specular", 1.0f, 1.0f, 1.0f);
-
-            lightColor = glm::vec3(0.0f, 0.0f, 1.0f);
-            diffuseColor = lightColor * glm::vec3(0.5f);
-            ambientColor = diffuseColor * glm::vec3(0.2f);
-
-            shaderProgram->setVec3("light[2].position", distance, 2.0f, -distance);
-            shaderProgram->setVec3("light[2].ambient", ambientColor);
-            shaderProgram->setVec3("light[2].diffuse", diffuseColor);
-            shaderProgram->setVec3("light[2].specular", 1.0f, 1.0f, 1.0f);
-
-
-            lightColor = glm::vec3(1.0f, 1.0f, 1.0f);
-            diffuseColor = lightColor * glm::vec3(0.5f);
-            ambientColor = diffuseColor * glm::vec3(0.2f);
-
-            shaderProgram->setVec3("light[3].position", 0.0f,22.0f, 0.0f);
-            shaderProgram->setVec3("light[3].ambient", ambientColor);
-            shaderProgram->setVec3("light[3].diffuse", diffuseColor);
-            shaderProgram->setVec3("light[3].specular", 1.0f, 1.0f, 1.0f);
-
+    // Uniforms the model vertex shaders use to decode compact vertices
+    static void setVertexDecode(const Shader& shaderProgram, bool compact, const VertexQuantization& q) {
+        const ModelUniformHandles& uniforms = shaderProgram.uniformSet<ModelUniformHandles>();
+        shaderProgram.set(uniforms.compactVertices, compact);
+        shaderProgram.set(uniforms.positionOffset, q.positionOffset);
+        shaderProgram.set(uniforms.positionScale, q.positionScale);
+        shaderProgram.set(uniforms.uvOffset, q.uvOffset);
+        shaderProgram.set(uniforms.uvScale, q.uvScale);
+    }
 
-            shaderProgram->setVec3("material.ambient", 0.3f, 0.6f, 0.2f);
-            shaderProgram->setVec3("material.diffuse", 1.0f, 1.0f, 1.0f);
-            shaderProgram->setVec3("material.specular", 0.5f, 0.5f, 0.5f);
-            shaderProgram->setFloat("material.shininess", .5f);
-     
+    void render(const Shader& shaderProgram) const {
+        if (!mesh || !mesh->isUploaded()) {
+            return;
         }
 
-        if (modelType == Parallax)
-        {
-            shaderProgram->setFloat("heightScale", 0.01f);
+        shaderProgram.set(shaderProgram.uniformSet<ModelUniformHandles>().transform, getModelMatrix());
+        setVertexDecode(shaderProgram, isCompact(mesh->format), mesh->quantization);
+        bindMaterial(shaderProgram, true);
+        mesh->draw();
+    }
+
+    // Draws count instances of this model's mesh and textures with the INSTANCED variant of
+    // its shader, transforms, layers and material come from instances [first, first + count)
+    void renderInstanced(const Shader& shaderProgram, const InstanceBuffer& instances, size_t first, GLsizei count) const {
+        if (!mesh || !mesh->isUploaded()) {
+            return;
         }
 
+        setVertexDecode(shaderProgram, isCompact(mesh->format), mesh->quantization);
+        bindMaterial(shaderProgram, false);
+        GLState::instance().bindVertexArray(mesh->VAO);
+        instances.attach(first);
+        mesh->drawInstanced(count);
+    }
 
-        if (texture0 && texture0->isLoaded) {
-            shaderProgram->setInt("texture1", 0);
-            texture0->bind(0);
+    InstanceData instanceData() const {
+        glm::mat4 modelMatrix = getModelMatrix();
+        glm::ivec4 material(-1, -1, -1, materialIndex);
+        const std::shared_ptr<Texture>* textures[3] = { &texture0, &texture1, &texture2 };
+        for (int slot = 0; slot < 3; ++slot) {
+            if (*textures[slot] && (*textures[slot])->array) {
+                material[slot] = textureLayers[slot];
+            }
         }
+        return { modelMatrix, glm::mat3(glm::transpose(glm::inverse(modelMatrix))), material };
+    }
 
-        if (texture1 && texture1->isLoaded) {
-            shaderProgram->setInt("texture2", 1);
-            texture1->bind(1);
+    // Uniforms and textures shared by every instance of the same mesh and texture set.
+    // Layers and material index are per instance in the INSTANCED shaders.
+    void bindMaterial(const Shader& shaderProgram, bool perModel) const {
+        // Camera, lights and materials come from the uniform blocks Scene fills once per frame
+        const ModelUniformHandles& uniforms = shaderProgram.uniformSet<ModelUniformHandles>();
+        if (perModel) {
+            shaderProgram.set(uniforms.materialIndex, materialIndex);
         }
 
-        if (texture2 && texture2->isLoaded) {
-            shaderProgram->setInt("texture3", 2);
-            texture2->bind(2);
+        if (modelType == Parallax)
+        {
+            shaderProgram.set(uniforms.heightScale, 0.01f);
         }
 
-        glBindVertexArray(VAO);
-        glDrawArrays(GL_TRIANGLES, 0, static_cast<GLsizei>(faces.size() * 3));
-        glBindVertexArray(0);
 
-        if (texture0 && texture0->isLoaded) {
-            texture0->unbind();
-        }
-        if (texture1 && texture1->isLoaded) {
-            texture1->unbind();
+        // Packed textures sample their array on units 3-5 with the model's layer index, the
+        // rest bind their own 2D texture on units 0-2. The sampler units are set once by Scene
+        // and binds that match the previous draw are skipped by GLState.
+        const std::shared_ptr<Texture>* textures[3] = { &texture0, &texture1, &texture2 };
+        for (int slot = 0; slot < 3; ++slot) {
+            const std::shared_ptr<Texture>& texture = *textures[slot];
+            if (!texture || !texture->isLoaded) {
+                continue;
+            }
+            if (texture->array) {
+                texture->array->bind(3 + slot);
+            }
+            else {
+                texture->bind(slot);
+            }
+            if (perModel) {
+                shaderProgram.set(uniforms.textureLayers[slot], texture->array ? textureLayers[slot] : -1);
+            }
         }
     }
 
-    void renderAABB(const glm::mat4& projectionMatrix, const glm::mat4& viewMatrix, std::shared_ptr<Shader> shaderProgram) const {
+    void renderAABB(std::shared_ptr<Shader> shaderProgram) const {
         // Get the transformed AABB
         AABB transformedAABB = getTransformedAABB();
 
@@ -503,7 +318,7 @@ public:
         glGenBuffers(1, &lineVBO);
 
         // Bind VAO
-        glBindVertexArray(lineVAO);
+        GLState::instance().bindVertexArray(lineVAO);
 
         // Bind and fill VBO
         glBindBuffer(GL_ARRAY_BUFFER, lineVBO);
@@ -521,60 +336,81 @@ public:
         glEnableVertexAttribArray(2); // Enable color attribute
 
         // Unbind VAO to avoid accidental changes
-        glBindVertexArray(0);
+        GLState::instance().bindVertexArray(0);
 
         // Optional: Unbind VBO (good practice, not strictly necessary)
         glBindBuffer(GL_ARRAY_BUFFER, 0);
 
         // Activate the shader and set uniforms
         shaderProgram->use();
-        shaderProgram->setMat4("projection", projectionMatrix);
-        shaderProgram->setMat4("view", viewMatrix);
-        shaderProgram->setMat4("transform", modelMatrix);
+        shaderProgram->set(shaderProgram->uniformSet<ModelUniformHandles>().transform, modelMatrix);
+        setVertexDecode(*shaderProgram, false, VertexQuantization());
 
         // Render the AABB lines
-        glBindVertexArray(lineVAO);
+        GLState::instance().bindVertexArray(lineVAO);
         glLineWidth(2.0f);
         glDrawArrays(GL_LINES, 0, static_cast<GLsizei>(lineVertices.size() / 6));
-        glBindVertexArray(0);
 
         // Cleanup OpenGL buffers
+        GLState::instance().forgetVertexArray(lineVAO);
         glDeleteVertexArrays(1, &lineVAO);
         glDeleteBuffers(1, &lineVBO);
     }
 
 
 
-    ~Model() {
-        if (VAO) {
-            glDeleteVertexArrays(1, &VAO);
-        }
-        if (VBO) {
-            glDeleteBuffers(1, &VBO);
+    // Only records the path, the usage of a slot (color, normal or height map) depends on
+    // the other slots and is known once the whole model is defined, see loadTextures
+    void setTexture(int pos, const std::string& path) {
+        if (pos < 0 || pos > 2) {
+            std::cout << "Wrong texture pos" << std::endl;
+            return;
         }
-    }
+        texturePaths[pos] = path;
 
-    void setTexture(int pos, const std::string& path) {
-        if (pos == 0) {
-            texture0 = std::make_shared<Texture>(path, GL_TEXTURE_2D);
+        if (!texturePaths[0].empty() && !texturePaths[1].empty() && !texturePaths[2].empty()) {
+            modelType = Parallax;
         }
-        else if (pos == 1) {
-            texture1 = std::make_shared<Texture>(path, GL_TEXTURE_2D);
+        else if (!texturePaths[0].empty() && !texturePaths[1].empty()) {
+            modelType = DoubleTextured;
         }
-        else if (pos == 2) {
-            texture2 = std::make_shared<Texture>(path, GL_TEXTURE_2D);
+        else if (!texturePaths[0].empty() || !texturePaths[1].empty()) {
+            modelType = Textured;
         }
         else {
-            std::cout << "Wrong texture pos" << std::endl;
+            modelType = Colored;
+        }
+    }
+
+    void loadTextures() {
+        std::shared_ptr<Texture>* slots[3] = { &texture0, &texture1, &texture2 };
+        for (int pos = 0; pos < 3; ++pos) {
+            if (texturePaths[pos].empty()) {
+                continue;
+            }
+            TextureUsage usage = ColorTexture;
+            if (modelType == Parallax) {
+                usage = pos == 1 ? NormalTexture : pos == 2 ? HeightTexture : ColorTexture;
+            }
+            *slots[pos] = TextureManager::instance().acquire(texturePaths[pos], GL_TEXTURE_2D, true, false, usage);
         }
+        updateModelType();
+    }
 
-        if (texture0 && texture0->isLoaded && texture1 && texture1->isLoaded && texture2 && texture2->isLoaded) {
+    // Falls back to the shader of the textures that did load. Asynchronous loads only report a
+    // failure once they are processed, so Scene calls this again when the loader is idle.
+    void updateModelType() {
+        auto loaded = [](const std::shared_ptr<Texture>& texture) {
+            return texture && texture->isLoaded && !texture->failed;
+        };
+
+        if (loaded(texture0) && loaded(texture1) && loaded(texture2)) {
             modelType = Parallax;
         }
-        else if (texture0 && texture0->isLoaded && texture1 && texture1->isLoaded ) {
+        else if (loaded(texture0) && loaded(texture1)) {
             modelType = DoubleTextured;
         }
-        else if ((texture0 && texture0->isLoaded) || (texture1 && texture1->isLoaded) ) {
+        else if (loaded(texture0) || loaded(texture1)) {
             modelType = Textured;
         }
         else {
@@ -599,4 +435,9 @@ public:
             (box1.min.y <= box2.max.y && box1.max.y >= box2.min.y) &&
             (box1.min.z <= box2.max.z && box1.max.z >= box2.min.z);
     }
+
+private:
+    mutable AABB worldBounds = { glm::vec3(0.0f), glm::vec3(0.0f) };
+    mutable glm::vec3 boundsPosition, boundsRotation, boundsScale;
+    mutable bool worldBoundsValid = false;
 };
@@ -0,0 +1,132 @@
+#pragma once
+
+#include <glad/gl.h>
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+#include <vector>
+#include <glm/glm.hpp>
+#include "GLState.h"
+
+#ifndef GL_DRAW_INDIRECT_BUFFER
+#define GL_DRAW_INDIRECT_BUFFER 0x8F3F
+#endif
+
+// Layout glMultiDrawElementsIndirect reads from GL_DRAW_INDIRECT_BUFFER
+struct DrawElementsIndirectCommand {
+    GLuint count;
+    GLuint instanceCount;
+    GLuint firstIndex;
+    GLint baseVertex;
+    GLuint baseInstance;
+};
+
+// Per draw data of a multi draw, fetched by the MULTI_DRAW shaders from a buffer texture with
+// the draw index every instance carries. Holds the compact vertex decode of the draw's mesh.
+struct DrawData {
+    glm::vec4 positionOffset;
+    glm::vec4 positionScale;
+    glm::vec4 uvOffsetScale;  // offset in xy, scale in zw
+};
+
+static_assert(sizeof(DrawData) == 3 * sizeof(glm::vec4), "DrawData is read as three RGBA32F texels");
+
+namespace MultiDrawIndirect {
+
+    typedef void (GLAD_API_PTR* MultiDrawElementsIndirectProc)(GLenum mode, GLenum type, const void* indirect, GLsizei drawCount, GLsizei stride);
+
+    // Turned off with --no-multi-draw, and by load() when the driver lacks GL 4.3
+    inline bool enabled = true;
+    inline MultiDrawElementsIndirectProc multiDrawElementsIndirect = nullptr;
+
+    inline bool hasExtension(const char* name) {
+        GLint count = 0;
+        glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+        for (GLint i = 0; i < count; ++i) {
+            const char* extension = reinterpret_cast<const char*>(glGetStringi(GL_EXTENSIONS, static_cast<GLuint>(i)));
+            if (extension && std::strcmp(extension, name) == 0) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // glad only loads GL 3.3, the 4.3 entry point is fetched here once the context exists.
+    // baseInstance in the commands needs GL 4.2 or ARB_base_instance as well.
+    inline bool load(GLADloadfunc getProcAddress) {
+        GLint major = 0, minor = 0;
+        glGetIntegerv(GL_MAJOR_VERSION, &major);
+        glGetIntegerv(GL_MINOR_VERSION, &minor);
+        bool supported = major > 4 || (major == 4 && minor >= 3) ||
+            (hasExtension("GL_ARB_multi_draw_indirect") && hasExtension("GL_ARB_base_instance"));
+
+        if (enabled && supported) {
+            multiDrawElementsIndirect = reinterpret_cast<MultiDrawElementsIndirectProc>(getProcAddress("glMultiDrawElementsIndirect"));
+        }
+        enabled = multiDrawElementsIndirect != nullptr;
+        std::cout << "Multi draw indirect: " << (enabled ? "on" : supported ? "off" : "not supported, using GL 3.3 draws") << std::endl;
+        return enabled;
+    }
+
+    inline bool available() {
+        return enabled && multiDrawElementsIndirect;
+    }
+}
+
+// Commands and per draw data of a frame's multi draws, uploaded together once per frame
+class IndirectDrawBuffer {
+public:
+    IndirectDrawBuffer() = default;
+    IndirectDrawBuffer(const IndirectDrawBuffer&) = delete;
+    IndirectDrawBuffer& operator=(const IndirectDrawBuffer&) = delete;
+
+    ~IndirectDrawBuffer() {
+        if (commandBuffer) {
+            GLState::instance().forgetTexture(dataTexture);
+            glDeleteTextures(1, &dataTexture);
+            glDeleteBuffers(1, &dataBuffer);
+            glDeleteBuffers(1, &commandBuffer);
+        }
+    }
+
+    // Orphans the previous storage like InstanceBuffer::upload
+    void upload(const std::vector<DrawElementsIndirectCommand>& commands, const std::vector<DrawData>& draws) {
+        if (commands.empty()) {
+            return;
+        }
+        if (!commandBuffer) {
+            glGenBuffers(1, &commandBuffer);
+            glGenBuffers(1, &dataBuffer);
+            glGenTextures(1, &dataTexture);
+        }
+        capacity = std::max(capacity, commands.size());
+
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, commandBuffer);
+        glBufferData(GL_DRAW_INDIRECT_BUFFER, static_cast<GLsizeiptr>(capacity * sizeof(DrawElementsIndirectCommand)), nullptr, GL_STREAM_DRAW);
+        glBufferSubData(GL_DRAW_INDIRECT_BUFFER, 0, static_cast<GLsizeiptr>(commands.size() * sizeof(DrawElementsIndirectCommand)), commands.data());
+
+        glBindBuffer(GL_TEXTURE_BUFFER, dataBuffer);
+        glBufferData(GL_TEXTURE_BUFFER, static_cast<GLsizeiptr>(capacity * sizeof(DrawData)), nullptr, GL_STREAM_DRAW);
+        glBufferSubData(GL_TEXTURE_BUFFER, 0, static_cast<GLsizeiptr>(draws.size() * sizeof(DrawData)), draws.data());
+        glBindBuffer(GL_TEXTURE_BUFFER, 0);
+
+        GLState::instance().bindTextureForUpdate(GL_TEXTURE_BUFFER, dataTexture);
+        glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, dataBuffer);
+    }
+
+    // Leaves the command buffer bound, nothing else in the renderer uses that target
+    void bind(unsigned int dataUnit) const {
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, commandBuffer);
+        GLState::instance().bindTexture(dataUnit, GL_TEXTURE_BUFFER, dataTexture);
+    }
+
+    void draw(size_t firstCommand, GLsizei commandCount, size_t instances) const {
+        const void* offset = reinterpret_cast<const void*>(firstCommand * sizeof(DrawElementsIndirectCommand));
+        MultiDrawIndirect::multiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT, offset, commandCount, 0);
+        GLState::instance().countDraw(instances);
+    }
+
+private:
+    GLuint commandBuffer = 0, dataBuffer = 0, dataTexture = 0;
+    size_t capacity = 0;
+};
@@ -0,0 +1,479 @@
+#pragma once
+
+#include <vector>
+#include <string>
+#include <fstream>
+#include <sstream>
+#include <iostream>
+#include <charconv>
+#include <chrono>
+#include <thread>
+#include <algorithm>
+#include <cstring>
+#include "MappedFile.h"
+
+struct Vertex {
+    float x, y, z;
+};
+
+struct TexCoord {
+    float u, v;
+};
+
+struct Normal {
+    float x, y, z;
+};
+
+// Indices are zero based, -1 marks a missing texture coordinate or normal
+struct Face {
+    int v[3], t[3], n[3];
+};
+
+struct ObjData {
+    std::vector<Vertex> vertices;
+    std::vector<TexCoord> texCoords;
+    std::vector<Normal> normals;
+    std::vector<Face> faces;
+
+    void clear() {
+        vertices.clear();
+        texCoords.clear();
+        normals.clear();
+        faces.clear();
+    }
+};
+
+// In-place OBJ tokenizer working directly on the mapped file bytes.
+// Supports "v", "vt", "vn" and "f" in the v, v/t, v//n and v/t/n forms,
+// negative (relative) indices and polygons, which are fan triangulated.
+namespace ObjParser {
+
+    inline bool isBlank(char c) {
+        return c == ' ' || c == '\t' || c == '\r';
+    }
+
+    inline const char* skipBlanks(const char* p, const char* end) {
+        while (p < end && isBlank(*p)) {
+            ++p;
+        }
+        return p;
+    }
+
+    inline const char* parseFloat(const char* p, const char* end, float& value) {
+        p = skipBlanks(p, end);
+        if (p < end && *p == '+') {
+            ++p;
+        }
+        auto result = std::from_chars(p, end, value);
+        if (result.ec != std::errc()) {
+            value = 0.0f;
+            // Skip the malformed token so the rest of the line still parses
+            while (p < end && !isBlank(*p) && *p != '\n') {
+                ++p;
+            }
+            return p;
+        }
+        return result.ptr;
+    }
+
+    // Converts a 1 based (or negative, relative) OBJ index into a 0 based one
+    inline int resolveIndex(int index, size_t count) {
+        if (index > 0) {
+            return index - 1;
+        }
+        if (index < 0) {
+            return static_cast<int>(count) + index;
+        }
+        return -1;
+    }
+
+    inline const char* parseIndex(const char* p, const char* end, int& index, bool& present) {
+        present = false;
+        if (p < end && *p == '+') {
+            ++p;
+        }
+        auto result = std::from_chars(p, end, index);
+        if (result.ec == std::errc()) {
+            present = true;
+            return result.ptr;
+        }
+        return p;
+    }
+
+    struct Corner {
+        int v, t, n;
+        unsigned char relative; // bit per v/t/n index that was negative in the file
+    };
+
+    // Faces in a chunk parsed on a worker thread resolve negative indices against the
+    // chunk's own counts. Every such index is recorded here so the merge can rebase it.
+    struct RelativeFixup {
+        size_t face;
+        unsigned char corner;
+        unsigned char kind; // 0 = v, 1 = t, 2 = n
+    };
+
+    // Parses a single "v/t/n" group, returns nullptr when there is nothing left on the line
+    inline const char* parseCorner(const char* p, const char* end, const ObjData& data, Corner& corner) {
+        p = skipBlanks(p, end);
+        if (p >= end || *p == '\n' || *p == '#') {
+            return nullptr;
+        }
+
+        int index = 0;
+        bool present = false;
+        corner = { -1, -1, -1, 0 };
+
+        p = parseIndex(p, end, index, present);
+        if (!present) {
+            // Not a number, skip the token
+            while (p < end && !isBlank(*p) && *p != '\n') {
+                ++p;
+            }
+            return p;
+        }
+        corner.v = resolveIndex(index, data.vertices.size());
+        corner.relative |= index < 0 ? 1 : 0;
+
+        if (p < end && *p == '/') {
+            ++p;
+            p = parseIndex(p, end, index, present);
+            if (present) {
+                corner.t = resolveIndex(index, data.texCoords.size());
+                corner.relative |= index < 0 ? 2 : 0;
+            }
+
+            if (p < end && *p == '/') {
+                ++p;
+                p = parseIndex(p, end, index, present);
+                if (present) {
+                    corner.n = resolveIndex(index, data.normals.size());
+                    corner.relative |= index < 0 ? 4 : 0;
+                }
+            }
+        }
+        return p;
+    }
+
+    inline void recordFixups(const Corner& corner, unsigned char slot, size_t face, std::vector<RelativeFixup>* fixups) {
+        if (!fixups || !corner.relative) {
+            return;
+        }
+        for (unsigned char kind = 0; kind < 3; ++kind) {
+            if (corner.relative & (1 << kind)) {
+                fixups->push_back({ face, slot, kind });
+            }
+        }
+    }
+
+    inline void parseFace(const char* p, const char* end, ObjData& data, std::vector<RelativeFixup>* fixups) {
+        Corner first{}, previous{}, current{};
+        int count = 0;
+
+        while ((p = parseCorner(p, end, data, current)) != nullptr) {
+            if (current.v < 0 && !(current.relative & 1)) {
+                // Skipped token. Relative indices may legitimately be negative inside a chunk.
+                continue;
+            }
+
+            if (count == 0) {
+                first = current;
+            }
+            else if (count >= 2) {
+                Face f;
+                f.v[0] = first.v;    f.t[0] = first.t;    f.n[0] = first.n;
+                f.v[1] = previous.v; f.t[1] = previous.t; f.n[1] = previous.n;
+                f.v[2] = current.v;  f.t[2] = current.t;  f.n[2] = current.n;
+                recordFixups(first, 0, data.faces.size(), fixups);
+                recordFixups(previous, 1, data.faces.size(), fixups);
+                recordFixups(current, 2, data.faces.size(), fixups);
+                data.faces.push_back(f);
+            }
+            previous = current;
+            ++count;
+        }
+    }
+
+    // Parses the [begin, end) range, appending to data. Negative indices are resolved
+    // against whatever is already stored in data and reported through fixups if given.
+    inline void parseRange(const char* begin, const char* end, ObjData& data, std::vector<RelativeFixup>* fixups = nullptr) {
+        const char* p = begin;
+        while (p < end) {
+            p = skipBlanks(p, end);
+            const char* lineEnd = p;
+            while (lineEnd < end && *lineEnd != '\n') {
+                ++lineEnd;
+            }
+
+            if (lineEnd - p >= 2 && isBlank(p[1])) {
+                if (p[0] == 'v') {
+                    Vertex v;
+                    const char* q = parseFloat(p + 2, lineEnd, v.x);
+                    q = parseFloat(q, lineEnd, v.y);
+                    parseFloat(q, lineEnd, v.z);
+                    data.vertices.push_back(v);
+                }
+                else if (p[0] == 'f') {
+                    parseFace(p + 2, lineEnd, data, fixups);
+                }
+            }
+            else if (lineEnd - p >= 3 && p[0] == 'v' && isBlank(p[2])) {
+                if (p[1] == 't') {
+                    TexCoord tc;
+                    const char* q = parseFloat(p + 3, lineEnd, tc.u);
+                    parseFloat(q, lineEnd, tc.v);
+                    data.texCoords.push_back(tc);
+                }
+                else if (p[1] == 'n') {
+                    Normal n;
+                    const char* q = parseFloat(p + 3, lineEnd, n.x);
+                    q = parseFloat(q, lineEnd, n.y);
+                    parseFloat(q, lineEnd, n.z);
+                    data.normals.push_back(n);
+                }
+            }
+
+            p = lineEnd + 1;
+        }
+    }
+
+    // Files smaller than this are not worth spreading over threads
+    constexpr size_t minChunkSize = 1 << 20;
+
+    struct Chunk {
+        const char* begin;
+        const char* end;
+        ObjData data;
+        std::vector<RelativeFixup> fixups;
+    };
+
+    // Splits the buffer at line boundaries into at most threadCount chunks
+    inline std::vector<Chunk> splitChunks(const char* begin, const char* end, unsigned threadCount) {
+        size_t size = static_cast<size_t>(end - begin);
+        size_t count = std::max<size_t>(1, std::min<size_t>(threadCount, size / minChunkSize));
+
+        std::vector<Chunk> chunks(count);
+        const char* chunkBegin = begin;
+        for (size_t i = 0; i < count; ++i) {
+            const char* chunkEnd = (i + 1 == count) ? end : begin + size * (i + 1) / count;
+            if (chunkEnd < chunkBegin) {
+                chunkEnd = chunkBegin;
+            }
+            if (chunkEnd < end) {
+                const char* newline = static_cast<const char*>(std::memchr(chunkEnd, '\n', end - chunkEnd));
+                chunkEnd = newline ? newline + 1 : end;
+            }
+            chunks[i].begin = chunkBegin;
+            chunks[i].end = chunkEnd;
+            chunkBegin = chunkEnd;
+        }
+        return chunks;
+    }
+
+    // Concatenates the chunks in file order and rebases relative indices, which gives
+    // exactly the same result as parsing the whole range sequentially
+    inline void mergeChunks(std::vector<Chunk>& chunks, ObjData& data) {
+        size_t vertexCount = 0, texCoordCount = 0, normalCount = 0, faceCount = 0;
+        for (const Chunk& chunk : chunks) {
+            vertexCount += chunk.data.vertices.size();
+            texCoordCount += chunk.data.texCoords.size();
+            normalCount += chunk.data.normals.size();
+            faceCount += chunk.data.faces.size();
+        }
+
+        data.vertices.reserve(vertexCount);
+        data.texCoords.reserve(texCoordCount);
+        data.normals.reserve(normalCount);
+        data.faces.reserve(faceCount);
+
+        for (Chunk& chunk : chunks) {
+            int base[3] = {
+                static_cast<int>(data.vertices.size()),
+                static_cast<int>(data.texCoords.size()),
+                static_cast<int>(data.normals.size())
+            };
+            size_t faceBase = data.faces.size();
+
+            data.vertices.insert(data.vertices.end(), chunk.data.vertices.begin(), chunk.data.vertices.end());
+            data.texCoords.insert(data.texCoords.end(), chunk.data.texCoords.begin(), chunk.data.texCoords.end());
+            data.normals.insert(data.normals.end(), chunk.data.normals.begin(), chunk.data.normals.end());
+            data.faces.insert(data.faces.end(), chunk.data.faces.begin(), chunk.data.faces.end());
+
+            for (const RelativeFixup& fixup : chunk.fixups) {
+                Face& f = data.faces[faceBase + fixup.face];
+                int* indices = fixup.kind == 0 ? f.v : (fixup.kind == 1 ? f.t : f.n);
+                indices[fixup.corner] += base[fixup.kind];
+            }
+
+            chunk.data.clear();
+            chunk.data.vertices.shrink_to_fit();
+            chunk.data.texCoords.shrink_to_fit();
+            chunk.data.normals.shrink_to_fit();
+            chunk.data.faces.shrink_to_fit();
+        }
+    }
+
+    // Drops faces with a vertex index outside the file's vertices, so MeshBuilder can index
+    // positions without checking. Texture coordinate and normal indices are checked where they
+    // are used, a bad one only loses that attribute. Only possible once the whole file is
+    // parsed, a chunk may use vertices defined in earlier chunks.
+    inline void dropInvalidFaces(const std::string& filename, ObjData& data) {
+        size_t vertexCount = data.vertices.size();
+        auto invalid = [vertexCount](const Face& f) {
+            for (int i = 0; i < 3; ++i) {
+                if (f.v[i] < 0 || static_cast<size_t>(f.v[i]) >= vertexCount) {
+                    return true;
+                }
+            }
+            return false;
+        };
+        size_t count = data.faces.size();
+        data.faces.erase(std::remove_if(data.faces.begin(), data.faces.end(), invalid), data.faces.end());
+        if (data.faces.size() != count) {
+            std::cerr << "Skipped " << count - data.faces.size() << " faces with out of range vertex indices in " << filename << std::endl;
+        }
+    }
+
+    // threadCount: 0 uses every hardware thread, 1 parses sequentially on the caller
+    inline bool parseFile(const std::string& filename, ObjData& data, unsigned threadCount = 0) {
+        MappedFile file(filename);
+        if (!file.isOpen()) {
+            return false;
+        }
+
+        data.clear();
+        const char* begin = file.data();
+        const char* end = file.data() + file.size();
+
+        if (threadCount == 0) {
+            threadCount = std::max(1u, std::thread::hardware_concurrency());
+        }
+
+        std::vector<Chunk> chunks = splitChunks(begin, end, threadCount);
+        if (chunks.size() == 1) {
+            parseRange(begin, end, data);
+            dropInvalidFaces(filename, data);
+            return true;
+        }
+
+        std::vector<std::thread> workers;
+        workers.reserve(chunks.size() - 1);
+        for (size_t i = 1; i < chunks.size(); ++i) {
+            workers.emplace_back([&chunk = chunks[i]]() {
+                parseRange(chunk.begin, chunk.end, chunk.data, &chunk.fixups);
+            });
+        }
+        parseRange(chunks[0].begin, chunks[0].end, chunks[0].data, &chunks[0].fixups);
+
+        for (std::thread& worker : workers) {
+            worker.join();
+        }
+
+        mergeChunks(chunks, data);
+        dropInvalidFaces(filename, data);
+        return true;
+    }
+
+    // Previous stream based parser, kept only as the baseline for benchmarkParsers
+    inline bool parseFileLegacy(const std::string& filename, ObjData& data) {
+        std::ifstream file(filename);
+        if (!file.is_open()) {
+            return false;
+        }
+
+        data.clear();
+        std::string line;
+        while (std::getline(file, line)) {
+            std::istringstream ss(line);
+            std::string prefix;
+            ss >> prefix;
+
+            if (prefix == "v") {
+                Vertex v;
+                ss >> v.x >> v.y >> v.z;
+                data.vertices.push_back(v);
+            }
+            else if (prefix == "vt") {
+                TexCoord tc;
+                ss >> tc.u >> tc.v;
+                data.texCoords.push_back(tc);
+            }
+            else if (prefix == "vn") {
+                Normal n;
+                ss >> n.x >> n.y >> n.z;
+                data.normals.push_back(n);
+            }
+            else if (prefix == "f") {
+                Face f = {};
+                for (int i = 0; i < 3; ++i) {
+                    std::string vertexData;
+                    ss >> vertexData;
+
+                    std::istringstream vertexStream(vertexData);
+                    std::string index;
+
+                    if (std::getline(vertexStream, index, '/')) {
+                        f.v[i] = std::stoi(index) - 1;
+                    }
+
+                    if (std::getline(vertexStream, index, '/')) {
+                        f.t[i] = !index.empty() ? std::stoi(index) - 1 : -1;
+                    }
+
+                    if (std::getline(vertexStream, index)) {
+                        f.n[i] = !index.empty() ? std::stoi(index) - 1 : -1;
+                    }
+                }
+                data.faces.push_back(f);
+            }
+        }
+        return true;
+    }
+
+    inline bool sameData(const ObjData& a, const ObjData& b) {
+        auto same = [](const auto& x, const auto& y) {
+            return x.size() == y.size() && (x.empty() || std::memcmp(x.data(), y.data(), x.size() * sizeof(x[0])) == 0);
+        };
+        return same(a.vertices, b.vertices) && same(a.texCoords, b.texCoords) &&
+            same(a.normals, b.normals) && same(a.faces, b.faces);
+    }
+
+    // Runs every parser over the same file and prints their throughput
+    inline void benchmarkParsers(const std::string& filename, int iterations = 20) {
+        MappedFile probe(filename);
+        if (!probe.isOpen()) {
+            std::cerr << "Failed to open OBJ file: " << filename << std::endl;
+            return;
+        }
+        double megabytes = static_cast<double>(probe.size()) / (1024.0 * 1024.0);
+        probe.close();
+
+        auto measure = [&](const char* name, auto parser) {
+            ObjData data;
+            auto start = std::chrono::high_resolution_clock::now();
+            for (int i = 0; i < iterations; ++i) {
+                parser(filename, data);
+            }
+            std::chrono::duration<double> elapsed = std::chrono::high_resolution_clock::now() - start;
+            double seconds = elapsed.count() / iterations;
+
+            std::cout << name << ": " << seconds * 1000.0 << " ms, "
+                << megabytes / seconds << " MB/s ("
+                << data.vertices.size() << " v, " << data.texCoords.size() << " vt, "
+                << data.normals.size() << " vn, " << data.faces.size() << " triangles)" << std::endl;
+            return data;
+        };
+
+        unsigned threads = std::max(1u, std::thread::hardware_concurrency());
+        std::cout << "OBJ parser benchmark: " << filename << " (" << megabytes << " MB, "
+            << iterations << " iterations, " << threads << " hardware threads)" << std::endl;
+        measure("  istringstream", parseFileLegacy);
+        ObjData sequential = measure("  mmap + from_chars, 1 thread", [](const std::string& f, ObjData& d) { return parseFile(f, d, 1); });
+        ObjData parallel = measure("  mmap + from_chars, all threads", [](const std::string& f, ObjData& d) { return parseFile(f, d, 0); });
+
+        if (size_t(megabytes * 1024.0 * 1024.0) < minChunkSize * 2) {
+            std::cout << "  (file below " << (minChunkSize * 2) / 1024 << " KB, threaded path parses it as a single chunk)" << std::endl;
+        }
+        std::cout << "  threaded output " << (sameData(sequential, parallel) ? "identical" : "DIFFERS") << " to sequential" << std::endl;
+    }
+}
@@ -0,0 +1,244 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <vector>
+#include <glm/glm.hpp>
+#include "Mesh.h"
+
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#include <xmmintrin.h>
+#define OCCLUSION_SSE 1
+#endif
+
+// Hierarchical-Z occlusion culling on the CPU. Large occluders are rasterized into a small
+// depth buffer, which is reduced into a pyramid keeping the farthest depth of every 2x2 block.
+// A box is occluded when its nearest depth is behind the farthest occluder depth over the
+// screen rectangle it covers, read from the level where that rectangle spans a few texels.
+// Depth is window z in [0, 1], 1 where nothing was drawn.
+class OcclusionCuller {
+public:
+    static constexpr int width = 256;
+    static constexpr int height = 128;
+
+    OcclusionCuller() {
+        int levelWidth = width, levelHeight = height;
+        while (true) {
+            levels.push_back({ levelWidth, levelHeight, std::vector<float>(static_cast<size_t>(levelWidth) * levelHeight, 1.0f) });
+            if (levelWidth == 1 || levelHeight == 1) {
+                break;
+            }
+            levelWidth /= 2;
+            levelHeight /= 2;
+        }
+    }
+
+    // Clears the depth buffer for a new frame
+    void begin(const glm::mat4& newViewProjection) {
+        viewProjection = newViewProjection;
+        std::fill(levels[0].depth.begin(), levels[0].depth.end(), 1.0f);
+        rasterStart = std::chrono::steady_clock::now();
+        occluderTriangles = 0;
+    }
+
+    void rasterize(const OccluderGeometry& geometry, const glm::mat4& modelMatrix) {
+        glm::mat4 transform = viewProjection * modelMatrix;
+        clipPositions.resize(geometry.positions.size());
+        for (size_t i = 0; i < geometry.positions.size(); ++i) {
+            clipPositions[i] = transform * glm::vec4(geometry.positions[i], 1.0f);
+        }
+        for (size_t i = 0; i + 2 < geometry.indices.size(); i += 3) {
+            drawClipped(clipPositions[geometry.indices[i]], clipPositions[geometry.indices[i + 1]], clipPositions[geometry.indices[i + 2]]);
+        }
+        occluderTriangles += geometry.indices.size() / 3;
+    }
+
+    // Builds the pyramid from the rasterized depth, call once after the last occluder
+    void end() {
+        for (size_t level = 1; level < levels.size(); ++level) {
+            const Level& source = levels[level - 1];
+            Level& target = levels[level];
+            for (int y = 0; y < target.height; ++y) {
+                const float* row0 = &source.depth[static_cast<size_t>(y * 2) * source.width];
+                const float* row1 = row0 + source.width;
+                float* out = &target.depth[static_cast<size_t>(y) * target.width];
+                for (int x = 0; x < target.width; ++x) {
+                    out[x] = std::max(std::max(row0[x * 2], row0[x * 2 + 1]), std::max(row1[x * 2], row1[x * 2 + 1]));
+                }
+            }
+        }
+        rasterMilliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - rasterStart).count();
+    }
+
+    // False only when the box is certainly hidden behind the occluders
+    bool isVisible(const AABB& box) const {
+        glm::vec2 lower(std::numeric_limits<float>::max()), upper(std::numeric_limits<float>::lowest());
+        float nearestDepth = 1.0f;
+        for (int corner = 0; corner < 8; ++corner) {
+            glm::vec3 point(corner & 1 ? box.max.x : box.min.x, corner & 2 ? box.max.y : box.min.y, corner & 4 ? box.max.z : box.min.z);
+            glm::vec4 clip = viewProjection * glm::vec4(point, 1.0f);
+            // A corner in front of the near plane puts the camera inside or right next to the box
+            if (clip.w <= nearW || clip.z < -clip.w) {
+                return true;
+            }
+            glm::vec3 window = toWindow(clip);
+            lower = glm::min(lower, glm::vec2(window));
+            upper = glm::max(upper, glm::vec2(window));
+            nearestDepth = std::min(nearestDepth, window.z);
+        }
+
+        // One pixel of margin, occluder pixels are covered when their center is
+        int x0 = std::max(static_cast<int>(std::floor(lower.x)) - 1, 0);
+        int y0 = std::max(static_cast<int>(std::floor(lower.y)) - 1, 0);
+        int x1 = std::min(static_cast<int>(std::ceil(upper.x)) + 1, width - 1);
+        int y1 = std::min(static_cast<int>(std::ceil(upper.y)) + 1, height - 1);
+        if (x0 > x1 || y0 > y1) {
+            return true;
+        }
+
+        // Finest level where the rectangle covers at most about 3x3 texels
+        size_t level = 0;
+        while (level + 1 < levels.size() && std::max(x1 - x0, y1 - y0) >> level > 2) {
+            ++level;
+        }
+        const Level& hiZ = levels[level];
+        int shift = static_cast<int>(level);
+        for (int y = y0 >> shift; y <= std::min(y1 >> shift, hiZ.height - 1); ++y) {
+            for (int x = x0 >> shift; x <= std::min(x1 >> shift, hiZ.width - 1); ++x) {
+                if (nearestDepth <= hiZ.depth[static_cast<size_t>(y) * hiZ.width + x]) {
+                    return true;
+                }
+            }
+        }
+        return false;
+    }
+
+    double lastRasterMilliseconds() const {
+        return rasterMilliseconds;
+    }
+
+    size_t lastOccluderTriangles() const {
+        return occluderTriangles;
+    }
+
+private:
+    struct Level {
+        int width, height;
+        std::vector<float> depth;
+    };
+
+    static constexpr float nearW = 1e-5f;
+
+    // Pixels with y up like GL, depth in [0, 1]
+    static glm::vec3 toWindow(const glm::vec4& clip) {
+        glm::vec3 ndc = glm::vec3(clip) / clip.w;
+        return glm::vec3((ndc.x * 0.5f + 0.5f) * width, (ndc.y * 0.5f + 0.5f) * height, ndc.z * 0.5f + 0.5f);
+    }
+
+    // Clips against the near plane (z >= -w) only, the screen bounds are handled by the
+    // bounding rectangle of each triangle and depth beyond the far plane never wins
+    void drawClipped(const glm::vec4& a, const glm::vec4& b, const glm::vec4& c) {
+        const glm::vec4 input[3] = { a, b, c };
+        glm::vec4 output[4];
+        int count = 0;
+        for (int i = 0; i < 3; ++i) {
+            const glm::vec4& current = input[i];
+            const glm::vec4& next = input[(i + 1) % 3];
+            float currentDistance = current.z + current.w, nextDistance = next.z + next.w;
+            if (currentDistance >= 0.0f) {
+                output[count++] = current;
+            }
+            if ((currentDistance >= 0.0f) != (nextDistance >= 0.0f)) {
+                output[count++] = current + (next - current) * (currentDistance / (currentDistance - nextDistance));
+            }
+        }
+        for (int i = 1; i + 1 < count; ++i) {
+            if (output[0].w > nearW && output[i].w > nearW && output[i + 1].w > nearW) {
+                drawTriangle(toWindow(output[0]), toWindow(output[i]), toWindow(output[i + 1]));
+            }
+        }
+    }
+
+    // Edge functions over pixel centers, four pixels of a row per step. Depth is linear in
+    // window space and kept as the nearest of what was drawn.
+    void drawTriangle(glm::vec3 v0, glm::vec3 v1, glm::vec3 v2) {
+        float area = (v1.x - v0.x) * (v2.y - v0.y) - (v1.y - v0.y) * (v2.x - v0.x);
+        if (std::abs(area) < 1e-8f) {
+            return;
+        }
+        // Both windings are drawn, occluder meshes are not guaranteed to be closed
+        if (area < 0.0f) {
+            std::swap(v1, v2);
+            area = -area;
+        }
+
+        int minX = std::max(static_cast<int>(std::floor(std::min({ v0.x, v1.x, v2.x }))), 0);
+        int minY = std::max(static_cast<int>(std::floor(std::min({ v0.y, v1.y, v2.y }))), 0);
+        int maxX = std::min(static_cast<int>(std::ceil(std::max({ v0.x, v1.x, v2.x }))), width - 1);
+        int maxY = std::min(static_cast<int>(std::ceil(std::max({ v0.y, v1.y, v2.y }))), height - 1);
+        if (minX > maxX || minY > maxY) {
+            return;
+        }
+        minX &= ~3;
+
+        // edge(x, y) = a * x + b * y + c, positive inside for counter clockwise triangles
+        const glm::vec3 vertices[3] = { v0, v1, v2 };
+        float edgeA[3], edgeB[3], edgeC[3];
+        for (int i = 0; i < 3; ++i) {
+            const glm::vec3& from = vertices[(i + 1) % 3];
+            const glm::vec3& to = vertices[(i + 2) % 3];
+            edgeA[i] = from.y - to.y;
+            edgeB[i] = to.x - from.x;
+            edgeC[i] = from.x * to.y - from.y * to.x;
+        }
+        // Edge i is opposite vertex i, so the edges divided by the area are barycentric weights
+        float depthX = (edgeA[0] * v0.z + edgeA[1] * v1.z + edgeA[2] * v2.z) / area;
+        float depthY = (edgeB[0] * v0.z + edgeB[1] * v1.z + edgeB[2] * v2.z) / area;
+        float depthC = (edgeC[0] * v0.z + edgeC[1] * v1.z + edgeC[2] * v2.z) / area;
+
+        std::vector<float>& depth = levels[0].depth;
+        for (int y = minY; y <= maxY; ++y) {
+            float centerY = y + 0.5f;
+            float* row = &depth[static_cast<size_t>(y) * width];
+            int x = minX;
+#if defined(OCCLUSION_SSE)
+            const __m128 laneOffsets = _mm_set_ps(3.5f, 2.5f, 1.5f, 0.5f);
+            for (; x + 4 <= width && x <= maxX; x += 4) {
+                __m128 centerX = _mm_add_ps(_mm_set1_ps(static_cast<float>(x)), laneOffsets);
+                __m128 inside = _mm_cmpeq_ps(centerX, centerX);
+                for (int i = 0; i < 3; ++i) {
+                    __m128 edge = _mm_add_ps(_mm_mul_ps(centerX, _mm_set1_ps(edgeA[i])), _mm_set1_ps(edgeB[i] * centerY + edgeC[i]));
+                    inside = _mm_and_ps(inside, _mm_cmpge_ps(edge, _mm_setzero_ps()));
+                }
+                if (_mm_movemask_ps(inside) == 0) {
+                    continue;
+                }
+                __m128 pixelDepth = _mm_add_ps(_mm_mul_ps(centerX, _mm_set1_ps(depthX)), _mm_set1_ps(depthY * centerY + depthC));
+                __m128 stored = _mm_loadu_ps(row + x);
+                __m128 nearest = _mm_min_ps(stored, pixelDepth);
+                _mm_storeu_ps(row + x, _mm_or_ps(_mm_and_ps(inside, nearest), _mm_andnot_ps(inside, stored)));
+            }
+#endif
+            for (; x <= maxX; ++x) {
+                float centerX = x + 0.5f;
+                bool inside = true;
+                for (int i = 0; i < 3; ++i) {
+                    inside = inside && edgeA[i] * centerX + edgeB[i] * centerY + edgeC[i] >= 0.0f;
+                }
+                if (inside) {
+                    row[x] = std::min(row[x], depthX * centerX + depthY * centerY + depthC);
+                }
+            }
+        }
+    }
+
+    glm::mat4 viewProjection = glm::mat4(1.0f);
+    std::vector<Level> levels;
+    std::vector<glm::vec4> clipPositions;
+    std::chrono::steady_clock::time_point rasterStart;
+    double rasterMilliseconds = 0.0;
+    size_t occluderTriangles = 0;
+};
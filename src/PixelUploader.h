@@ -0,0 +1,200 @@
+#pragma once
+
+#include <glad/gl.h>
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+#include "DecodedImage.h"
+#include "GLState.h"
+
+// Streams pixel data to textures through a ring of pixel unpack buffers. Each upload is
+// copied into the next PBO and glTexSubImage2D reads from it, so the driver can DMA the
+// data while the CPU moves on. A fence per slot keeps a buffer from being overwritten
+// before the GPU has consumed it. Images larger than a slot go up in row bands.
+class PixelUploadRing {
+public:
+    static constexpr int slotCount = 3;
+    static constexpr size_t slotSize = 4 << 20;
+
+    // Upload through the ring instead of passing client memory to glTexImage2D
+    static inline bool usePixelBuffers = true;
+
+    static PixelUploadRing& instance() {
+        static PixelUploadRing ring;
+        return ring;
+    }
+
+    PixelUploadRing(const PixelUploadRing&) = delete;
+    PixelUploadRing& operator=(const PixelUploadRing&) = delete;
+
+    ~PixelUploadRing() {
+        for (Slot& slot : slots) {
+            if (slot.fence) {
+                glDeleteSync(slot.fence);
+            }
+            if (slot.buffer) {
+                glDeleteBuffers(1, &slot.buffer);
+            }
+        }
+    }
+
+    // Fills one level of an already allocated target (a 2D texture or one cubemap face).
+    // The texture has to be bound to its binding point.
+    void upload(GLenum target, int level, int width, int height, GLenum format, int channels, const unsigned char* pixels) {
+        size_t rowBytes = static_cast<size_t>(width) * channels;
+        int rowsPerBand = static_cast<int>(std::max<size_t>(1, slotSize / rowBytes));
+
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+        for (int y = 0; y < height; y += rowsPerBand) {
+            int rows = std::min(rowsPerBand, height - y);
+            size_t bytes = rowBytes * rows;
+            Slot& slot = acquireSlot(bytes);
+
+            glBindBuffer(GL_PIXEL_UNPACK_BUFFER, slot.buffer);
+            void* mapped = glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, static_cast<GLsizeiptr>(bytes),
+                GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+            if (mapped) {
+                std::memcpy(mapped, pixels + rowBytes * y, bytes);
+                glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+                glTexSubImage2D(target, level, 0, y, width, rows, format, GL_UNSIGNED_BYTE, nullptr);
+            }
+            else {
+                glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+                glTexSubImage2D(target, level, 0, y, width, rows, format, GL_UNSIGNED_BYTE, pixels + rowBytes * y);
+            }
+            slot.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+            bytesStreamed += bytes;
+        }
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    }
+
+    // One compressed mip level, glCompressedTexImage2D allocates and fills it from the PBO
+    void uploadCompressed(GLenum target, int level, GLenum internalFormat, int width, int height, const uint8_t* data, size_t size) {
+        Slot& slot = acquireSlot(size);
+
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, slot.buffer);
+        void* mapped = glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, static_cast<GLsizeiptr>(size),
+            GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+        if (mapped) {
+            std::memcpy(mapped, data, size);
+            glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+            glCompressedTexImage2D(target, level, internalFormat, width, height, 0, static_cast<GLsizei>(size), nullptr);
+        }
+        else {
+            glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+            glCompressedTexImage2D(target, level, internalFormat, width, height, 0, static_cast<GLsizei>(size), data);
+        }
+        slot.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        bytesStreamed += size;
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    }
+
+    void printStats() const {
+        std::cout << "Pixel uploads: " << bytesStreamed / 1024 << " KB streamed, " << stalls << " fence stalls" << std::endl;
+    }
+
+private:
+    struct Slot {
+        GLuint buffer = 0;
+        size_t capacity = 0;
+        GLsync fence = nullptr;
+    };
+
+    PixelUploadRing() = default;
+
+    // Next slot in the ring, waiting for the GPU if it still reads from it
+    Slot& acquireSlot(size_t bytes) {
+        Slot& slot = slots[next];
+        next = (next + 1) % slotCount;
+
+        if (slot.fence) {
+            GLenum result = glClientWaitSync(slot.fence, 0, 0);
+            if (result == GL_TIMEOUT_EXPIRED) {
+                ++stalls;
+                while (glClientWaitSync(slot.fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000) == GL_TIMEOUT_EXPIRED) {
+                }
+            }
+            glDeleteSync(slot.fence);
+            slot.fence = nullptr;
+        }
+
+        if (!slot.buffer) {
+            glGenBuffers(1, &slot.buffer);
+        }
+        if (slot.capacity < bytes) {
+            slot.capacity = std::max(bytes, slotSize);
+            glBindBuffer(GL_PIXEL_UNPACK_BUFFER, slot.buffer);
+            glBufferData(GL_PIXEL_UNPACK_BUFFER, static_cast<GLsizeiptr>(slot.capacity), nullptr, GL_STREAM_DRAW);
+        }
+        return slot;
+    }
+
+    Slot slots[slotCount];
+    int next = 0;
+    size_t bytesStreamed = 0;
+    size_t stalls = 0;
+};
+
+// Times glTexImage2D from client memory against the PBO ring on already decoded images,
+// needs a current GL context. Both paths end with glFinish so the transfer is included.
+inline void benchmarkPixelUploads(const std::vector<std::string>& paths, int iterations = 10) {
+    std::vector<DecodedImage> images;
+    size_t totalBytes = 0;
+    for (const std::string& path : paths) {
+        DecodedImage image = DecodedImage::decode(path, false);
+        if (!image) {
+            std::cerr << "Failed to load texture: " << path << std::endl;
+            continue;
+        }
+        totalBytes += static_cast<size_t>(image.width) * image.height * image.nrChannels;
+        images.push_back(std::move(image));
+    }
+    if (images.empty()) {
+        return;
+    }
+
+    std::vector<GLuint> textures(images.size());
+    glGenTextures(static_cast<GLsizei>(textures.size()), textures.data());
+
+    auto run = [&](bool pixelBuffers) {
+        auto start = std::chrono::high_resolution_clock::now();
+        for (int i = 0; i < iterations; ++i) {
+            for (size_t t = 0; t < images.size(); ++t) {
+                const DecodedImage& image = images[t];
+                GLenum format = image.nrChannels == 4 ? GL_RGBA : GL_RGB;
+                GLState::instance().bindTextureForUpdate(GL_TEXTURE_2D, textures[t]);
+                if (pixelBuffers) {
+                    glTexImage2D(GL_TEXTURE_2D, 0, format, image.width, image.height, 0, format, GL_UNSIGNED_BYTE, nullptr);
+                    PixelUploadRing::instance().upload(GL_TEXTURE_2D, 0, image.width, image.height, format, image.nrChannels, image.pixels.get());
+                }
+                else {
+                    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+                    glTexImage2D(GL_TEXTURE_2D, 0, format, image.width, image.height, 0, format, GL_UNSIGNED_BYTE, image.pixels.get());
+                    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+                }
+            }
+        }
+        glFinish();
+        std::chrono::duration<double, std::milli> elapsed = std::chrono::high_resolution_clock::now() - start;
+        return elapsed.count() / iterations;
+    };
+
+    run(false);
+    double direct = run(false);
+    double streamed = run(true);
+    double megabytes = totalBytes / (1024.0 * 1024.0);
+
+    std::cout << images.size() << " images, " << megabytes << " MB per pass" << std::endl;
+    std::cout << "  glTexImage2D: " << direct << " ms (" << megabytes * 1000.0 / direct << " MB/s)" << std::endl;
+    std::cout << "  PBO ring:     " << streamed << " ms (" << megabytes * 1000.0 / streamed << " MB/s)" << std::endl;
+    PixelUploadRing::instance().printStats();
+
+    for (GLuint texture : textures) {
+        GLState::instance().forgetTexture(texture);
+    }
+    glDeleteTextures(static_cast<GLsizei>(textures.size()), textures.data());
+}
@@ -143,5 +143,5 @@ void Player::ApplyFallDamage()
 }
 
 void Player::render(Scene& scene) {
-    playerModel.render(scene.GetShader(playerModel, camera), camera->position);
+    playerModel.render(*scene.GetShader(playerModel));
 }
@@ -0,0 +1,158 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+#include "Model.h"
+#include "Shader.h"
+
+// Draws collected for a frame and submitted in the order of a 64-bit key, so draws that share a
+// program, textures and mesh end up next to each other and opaque geometry goes front to back.
+//
+//   opaque       pass:2 | program:8 | texture set:14 | mesh:16 | depth:24
+//   transparent  pass:2 | inverted depth:24 | program:8 | texture set:14 | mesh:16
+//
+// Transparent draws sort back to front first and are not used by the scene yet.
+class RenderQueue {
+public:
+    enum Pass {
+        OpaquePass = 0,
+        TransparentPass = 1
+    };
+
+    // The scene owns the models and shaders and keeps them alive for the whole frame
+    struct Packet {
+        const Model* model;
+        const Shader* shader;
+    };
+
+    void clear() {
+        packets.clear();
+        items.clear();
+        programs.clear();
+        textureSets.clear();
+        meshes.clear();
+    }
+
+    // depth is the view distance divided by the far plane, clamped to [0, 1]
+    void push(Pass pass, const Model& model, const Shader& shader, uint64_t textureState, uint32_t mesh, float depth) {
+        uint64_t program = denseId(programs, shader.ID) & 0xFFu;
+        uint64_t textures = denseId(textureSets, textureState) & 0x3FFFu;
+        uint64_t meshId = denseId(meshes, mesh) & 0xFFFFu;
+        uint64_t depthBits = static_cast<uint64_t>(std::min(std::max(depth, 0.0f), 1.0f) * 0xFFFFFF) & 0xFFFFFFu;
+
+        uint64_t key = static_cast<uint64_t>(pass) << 62;
+        if (pass == OpaquePass) {
+            key |= program << 54 | textures << 40 | meshId << 24 | depthBits;
+        }
+        else {
+            key |= (0xFFFFFFu - depthBits) << 38 | program << 30 | textures << 16 | meshId;
+        }
+
+        items.push_back({ key, static_cast<uint32_t>(packets.size()) });
+        packets.push_back({ &model, &shader });
+    }
+
+    void sort() {
+        radixSort(items, scratch);
+    }
+
+    template <typename Submit>
+    void submit(Submit&& draw) const {
+        for (const Item& item : items) {
+            draw(packets[item.packet]);
+        }
+    }
+
+    // Hands runs of consecutive opaque packets with the same program, texture set and mesh to
+    // draw(packets, count), so they can be drawn as one instanced draw. Runs are found from the
+    // key bits, like the sort, and confirmed on the packets in case a frame has more programs,
+    // texture sets or meshes than the key has room for. Transparent packets come one at a time
+    // to keep their order.
+    template <typename Submit>
+    void submitBatches(Submit&& draw) {
+        for (size_t begin = 0; begin < items.size();) {
+            uint64_t state = items[begin].key >> 24;
+            size_t end = begin + 1;
+            if ((items[begin].key >> 62) == OpaquePass) {
+                while (end < items.size() && (items[end].key >> 24) == state &&
+                    sameState(packets[items[begin].packet], packets[items[end].packet])) {
+                    ++end;
+                }
+            }
+
+            run.clear();
+            for (size_t i = begin; i < end; ++i) {
+                run.push_back(&packets[items[i].packet]);
+            }
+            draw(run.data(), run.size());
+            begin = end;
+        }
+    }
+
+    size_t size() const {
+        return packets.size();
+    }
+
+private:
+    struct Item {
+        uint64_t key;
+        uint32_t packet;
+    };
+
+    // Least significant digit first, 8 bits per pass. Passes whose digit is the same for every
+    // item are skipped, with a handful of programs and meshes most of them are.
+    static void radixSort(std::vector<Item>& items, std::vector<Item>& scratch) {
+        if (items.size() < 2) {
+            return;
+        }
+        scratch.resize(items.size());
+        std::vector<Item>* source = &items;
+        std::vector<Item>* target = &scratch;
+
+        for (int shift = 0; shift < 64; shift += 8) {
+            size_t counts[256] = {};
+            for (const Item& item : *source) {
+                ++counts[(item.key >> shift) & 0xFF];
+            }
+            if (counts[((*source)[0].key >> shift) & 0xFF] == source->size()) {
+                continue;
+            }
+
+            size_t offset = 0;
+            for (size_t& count : counts) {
+                size_t next = offset + count;
+                count = offset;
+                offset = next;
+            }
+            for (const Item& item : *source) {
+                (*target)[counts[(item.key >> shift) & 0xFF]++] = item;
+            }
+            std::swap(source, target);
+        }
+
+        if (source != &items) {
+            items.swap(*source);
+        }
+    }
+
+    // Dense ids in first-seen order per frame, so the key bits are enough for any GL names,
+    // texture states or mesh ids
+    static uint32_t denseId(std::unordered_map<uint64_t, uint32_t>& ids, uint64_t value) {
+        auto it = ids.emplace(value, static_cast<uint32_t>(ids.size())).first;
+        return it->second;
+    }
+
+    static bool sameState(const Packet& a, const Packet& b) {
+        return a.shader == b.shader && a.model->mesh == b.model->mesh && a.model->textureState() == b.model->textureState();
+    }
+
+    std::vector<Packet> packets;
+    std::vector<Item> items;
+    std::vector<Item> scratch;
+    std::vector<const Packet*> run;
+    std::unordered_map<uint64_t, uint32_t> programs;
+    std::unordered_map<uint64_t, uint32_t> textureSets;
+    std::unordered_map<uint64_t, uint32_t> meshes;
+};
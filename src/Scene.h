@@ -1,28 +1,75 @@
 #pragma once
 
+#include <algorithm>
 #include <vector>
 #include <string>
 #include <fstream>
 #include <sstream>
 #include <iostream>
+#include <chrono>
 #include "Model.h"
 #include "Model.h"
+#include "TextureArray.h"
+#include "TextureStreamer.h"
+#include "RenderQueue.h"
+#include "MultiDraw.h"
+#include "Frustum.h"
+#include "BVH.h"
+#include "SpatialHashGrid.h"
+#include "SweepAndPrune.h"
+#include "OcclusionCuller.h"
 #include "Skybox.h"
 #include "CollisionResult.h"
 
 class Scene
 {
 public:
+    // Draw runs of models that share program, textures and mesh with one instanced draw
+    static inline bool useInstancing = true;
+    // Skip models whose world bounds are outside the view frustum
+    static inline bool useFrustumCulling = true;
+    // Cull through the BVH instead of testing every model
+    static inline bool useBVH = true;
+    // Find player collisions in the spatial hash grid instead of testing every model
+    static inline bool useCollisionGrid = true;
+    // Skip models hidden behind large occluders, tested against a CPU rasterized depth pyramid
+    static inline bool useOcclusionCulling = true;
+    // Prints the culling counters about once a second
+    static inline bool printCullStats = false;
+
+    struct CullStats
+    {
+        size_t visible = 0;
+        size_t culled = 0;
+        size_t occluded = 0;
+        size_t occluders = 0;
+        double rasterMilliseconds = 0.0;  // occluder rasterization and pyramid build
+    };
+
     Scene(glm::mat4 projection);
     bool loadFromFile(const std::string& filePath);
     void update(float deltaTime);
+    void streamTextures(const Camera& camera, float viewportHeight) const;
     CollisionResult checkPlayerCollision(Model& playerModel);
+    // Contacts among models moving on their own (props, NPCs), not the level geometry
+    std::vector<BodyCollision> checkBodyCollisions(const std::vector<Model*>& bodies);
+    // Nearest model whose world bounds the ray hits, index into the scene's models
+    BVH::RayHit raycast(const glm::vec3& origin, const glm::vec3& direction, float maxDistance) const;
+    // Call after moving scene models, the next update() refits the BVH and rebuilds the grid
+    void invalidateBounds() { boundsMoved = true; }
     void render(std::shared_ptr <Camera>& camera) const;
 
-    std::shared_ptr<Shader> GetShader(const Model& model, std::shared_ptr <Camera>& camera) const;
+    std::shared_ptr<Shader> GetShader(const Model& model) const;
+    const std::shared_ptr<Shader>& shaderFor(const Model& model) const;
+    const std::shared_ptr<Shader>& instancedShaderFor(const Model& model) const;
     void setSkybox(const std::vector<std::string>& skyboxTextures);
+    const CullStats& lastCullStats() const { return cullStats; }
 
 private:
+    void packTextures();
+    void cullModels(const glm::mat4& viewProjection, const glm::vec3& eye) const;
+    size_t cullOccluded(const glm::mat4& viewProjection, const glm::vec3& eye) const;
+    std::vector<AABB> modelBounds() const;
 
     glm::mat4 projection;
     std::vector<Model> sceneModels;
@@ -30,8 +77,52 @@ private:
     std::shared_ptr<Shader> doubletexturedShader;
     std::shared_ptr<Shader> coloredShader;
     std::shared_ptr<Shader> parallaxShader;
+    std::shared_ptr<Shader> instancedTexturedShader;
+    std::shared_ptr<Shader> instancedDoubletexturedShader;
+    std::shared_ptr<Shader> instancedColoredShader;
+    std::shared_ptr<Shader> instancedParallaxShader;
     std::shared_ptr<Shader> skyboxShader;
     std::shared_ptr<Skybox> skybox;
+    UniformBuffer<FrameUniforms> frameUniforms{ FrameBlock };
+    UniformBuffer<LightsUniforms> lightUniforms{ LightsBlock };
+    UniformBuffer<MaterialsUniforms> materialUniforms{ MaterialsBlock };
+    std::vector<std::shared_ptr<TextureArray>> textureArrays;
+    bool texturesPacked = false;
+    // Texture unit of the buffer texture with the per draw data of multi draws
+    static constexpr unsigned int drawDataUnit = 6;
+    mutable RenderQueue renderQueue;
+    BVH modelBVH;
+    SpatialHashGrid collisionGrid;
+    SweepAndPrune bodyBroadphase;
+    // Broadphase boxes are padded by this, bodies about to touch are paired a frame early
+    static constexpr float bodyMargin = 0.05f;
+    bool boundsMoved = false;
+    mutable BoundsArray worldBounds;
+    mutable std::vector<uint8_t> visibility;
+    mutable OcclusionCuller occlusionCuller;
+    // Models big enough to hide others, chosen at load. Each frame the visible ones covering
+    // the most of the screen are rasterized, up to maxOccluders.
+    std::vector<size_t> occluderCandidates;
+    mutable std::vector<std::pair<float, size_t>> occluders;
+    static constexpr float occluderMinSize = 2.0f;
+    static constexpr size_t maxOccluders = 16;
+    mutable CullStats cullStats;
+    mutable std::chrono::steady_clock::time_point lastCullPrint;
+
+    struct DrawBatch
+    {
+        enum Kind { Single, Instanced, MultiDraw } kind;
+        const RenderQueue::Packet* packet;
+        size_t first;    // first instance, or first command of a multi draw
+        GLsizei count;   // instances, or commands of a multi draw
+        size_t instances;
+    };
+    mutable std::vector<DrawBatch> drawBatches;
+    mutable std::vector<InstanceData> instanceData;
+    mutable InstanceBuffer instanceBuffer;
+    mutable std::vector<DrawElementsIndirectCommand> drawCommands;
+    mutable std::vector<DrawData> drawData;
+    mutable IndirectDrawBuffer indirectBuffer;
 };
 
 Scene::Scene(glm::mat4 projection)
@@ -53,10 +144,81 @@ Scene::Scene(glm::mat4 projection)
     skyboxShader = std::make_shared<Shader>(
         "src/Shaders/SkyboxShader/VertexShader.vs",
         "src/Shaders/SkyboxShader/FragmentShader.fs");
+
+    // With multi draw indirect every instanced draw is a multi draw, the instanced shaders then
+    // read the mesh decode values per draw
+    std::vector<std::string> instanced = { "INSTANCED" };
+    if (MultiDrawIndirect::available())
+        instanced.push_back("MULTI_DRAW");
+    instancedTexturedShader = std::make_shared<Shader>(
+        "src/Shaders/LightsTexturedShader/VertexShader.vs",
+        "src/Shaders/LightsTexturedShader/FragmentShader.fs", instanced);
+    instancedColoredShader = std::make_shared<Shader>(
+        "src/Shaders/LightsShader/VertexShader.vs",
+        "src/Shaders/LightsShader/FragmentShader.fs", instanced);
+    instancedDoubletexturedShader = std::make_shared<Shader>(
+        "src/Shaders/DoubleTexturedShader/VertexShader.vs",
+        "src/Shaders/DoubleTexturedShader/FragmentShader.fs", instanced);
+    instancedParallaxShader = std::make_shared<Shader>(
+        "src/Shaders/Parallax/VertexShader.vs",
+        "src/Shaders/Parallax/FragmentShader.fs", instanced);
+
+    // Four colored point lights around the origin and one white light above the level
+    LightsUniforms lights = {};
+    const float distance = 4.0f;
+    const glm::vec3 lightPositions[maxLights] = {
+        glm::vec3(distance, 2.0f, distance), glm::vec3(-distance, 2.0f, distance),
+        glm::vec3(distance, 2.0f, -distance), glm::vec3(0.0f, 22.0f, 0.0f) };
+    const glm::vec3 lightColors[maxLights] = {
+        glm::vec3(1.0f, 0.0f, 0.0f), glm::vec3(0.0f, 1.0f, 0.0f), glm::vec3(0.0f, 0.0f, 1.0f), glm::vec3(1.0f) };
+    for (int i = 0; i < maxLights; ++i)
+    {
+        glm::vec3 diffuseColor = lightColors[i] * glm::vec3(0.5f);
+        lights.light[i].position = glm::vec4(lightPositions[i], 1.0f);
+        lights.light[i].ambient = glm::vec4(diffuseColor * glm::vec3(0.2f), 0.0f);
+        lights.light[i].diffuse = glm::vec4(diffuseColor, 0.0f);
+        lights.light[i].specular = glm::vec4(1.0f);
+    }
+    lightUniforms.update(lights);
+
+    MaterialsUniforms materials = {};
+    materials.materials[0] = { glm::vec4(0.3f, 0.6f, 0.2f, 0.0f), glm::vec4(1.0f), glm::vec3(0.5f), 0.5f };
+    materialUniforms.update(materials);
+
+    // 2D samplers use units 0-2 and the array samplers units 3-5, two sampler types must
+    // never share a unit
+    const std::shared_ptr<Shader> textured[] = { texturedShader, doubletexturedShader, parallaxShader,
+        instancedTexturedShader, instancedDoubletexturedShader, instancedParallaxShader };
+    for (const auto& shader : textured)
+    {
+        shader->use();
+        // Variants only declare the slots they sample, the others are skipped without a warning
+        for (int slot = 0; slot < 3; ++slot)
+        {
+            std::string texture = "texture" + std::to_string(slot + 1);
+            std::string textureArray = "textureArray" + std::to_string(slot + 1);
+            if (shader->hasUniform(UniformId(texture.c_str())))
+                shader->setInt(texture, slot);
+            if (shader->hasUniform(UniformId(textureArray.c_str())))
+                shader->setInt(textureArray, 3 + slot);
+        }
+    }
+    if (MultiDrawIndirect::available())
+    {
+        for (const auto& shader : { instancedTexturedShader, instancedDoubletexturedShader, instancedColoredShader, instancedParallaxShader })
+        {
+            shader->use();
+            shader->setInt("drawData", drawDataUnit);
+        }
+    }
 }
 
 bool Scene::loadFromFile(const std::string& filePath)
 {
+    auto loadStart = std::chrono::high_resolution_clock::now();
+    texturesPacked = false;
+    Mesh::keepOccluders = useOcclusionCulling;
+
     std::ifstream file(filePath);
     if (!file.is_open())
     {
@@ -160,6 +322,36 @@ bool Scene::loadFromFile(const std::string& filePath)
             lineStream >> sx >> sy >> sz;
             sceneModels.back().setScale(sx, sy, sz);
         }
+        else if (command == "Repeat")
+        {
+            // Repeat countX countY countZ stepX stepY stepZ, a grid of copies of the last model
+            // starting at its position, for stress levels
+            if (sceneModels.empty())
+            {
+                std::cerr << "Repeat command before any Model command." << std::endl;
+                continue;
+            }
+
+            int countX = 1, countY = 1, countZ = 1;
+            glm::vec3 step(0.0f);
+            lineStream >> countX >> countY >> countZ >> step.x >> step.y >> step.z;
+            Model original = sceneModels.back();
+            sceneModels.reserve(sceneModels.size() + static_cast<size_t>(std::max(countX * countY * countZ - 1, 0)));
+            for (int x = 0; x < countX; ++x)
+            {
+                for (int y = 0; y < countY; ++y)
+                {
+                    for (int z = 0; z < countZ; ++z)
+                    {
+                        if (x == 0 && y == 0 && z == 0)
+                            continue;
+                        Model copy = original;
+                        copy.position = original.position + step * glm::vec3(x, y, z);
+                        sceneModels.push_back(std::move(copy));
+                    }
+                }
+            }
+        }
         else if (command == "Skybox")
         {
             std::vector<std::string> skyboxTextures(6);
@@ -180,22 +372,123 @@ bool Scene::loadFromFile(const std::string& filePath)
 
     for (auto& model : sceneModels)
     {
+        model.loadTextures();
         model.setupBuffers();
     }
+    std::vector<AABB> bounds = modelBounds();
+    modelBVH.build(bounds);
+    collisionGrid.build(bounds);
+    boundsMoved = false;
+
+    occluderCandidates.clear();
+    for (size_t i = 0; i < sceneModels.size(); ++i)
+    {
+        glm::vec3 size = bounds[i].max - bounds[i].min;
+        if (sceneModels[i].mesh && !sceneModels[i].mesh->occluder.empty() && std::max({ size.x, size.y, size.z }) >= occluderMinSize)
+            occluderCandidates.push_back(i);
+    }
 
 
     file.close();
+
+    std::chrono::duration<double, std::milli> loadTime = std::chrono::high_resolution_clock::now() - loadStart;
+    std::cout << "Scene " << filePath << " loaded in " << loadTime.count() << " ms" << std::endl;
+    MeshRegistry::instance().collectGarbage();
+    MeshRegistry::instance().printStats();
+    TextureManager::instance().evictUnused();
+    if (TextureLoader::instance().idle())
+        TextureManager::instance().printStats();
     return true;
 }
 
 void Scene::update(float deltaTime = 0.0f)
 {
+    if (boundsMoved)
+    {
+        std::vector<AABB> bounds = modelBounds();
+        modelBVH.update(bounds);
+        collisionGrid.build(bounds);
+        boundsMoved = false;
+    }
 
+    // Packing needs the final size and format of every texture, so it waits for the loader.
+    // Models whose textures failed to load fall back to another shader at the same point.
+    if (!texturesPacked && TextureLoader::instance().idle())
+    {
+        for (Model& model : sceneModels)
+            model.updateModelType();
+        packTextures();
+        texturesPacked = true;
+    }
+}
+
+// Screen size of every model's bounding sphere, in pixels, for the mip levels its textures need
+void Scene::streamTextures(const Camera& camera, float viewportHeight) const
+{
+    if (!TextureStreamer::enabled())
+        return;
+
+    float focalLength = viewportHeight * 0.5f * projection[1][1];
+    std::vector<TextureStreamer::Use> uses;
+    for (const Model& model : sceneModels)
+    {
+        const AABB& bounds = model.getWorldAABB();
+        glm::vec3 center = (bounds.min + bounds.max) * 0.5f;
+        float radius = glm::length(bounds.max - bounds.min) * 0.5f;
+        float distance = std::max(glm::length(center - camera.position) - radius, 0.1f);
+        float screenSize = 2.0f * radius / distance * focalLength;
+
+        for (const auto& texture : { model.texture0, model.texture1, model.texture2 })
+        {
+            if (texture)
+                uses.push_back({ texture, screenSize });
+        }
+    }
+    TextureStreamer::instance().update(uses);
+}
+
+void Scene::packTextures()
+{
+    // Layers of an array can not drop mip levels on their own, streamed textures stay 2D
+    if (!TextureArrayPacker::enabled || TextureStreamer::enabled())
+        return;
+
+    std::vector<std::shared_ptr<Texture>> textures;
+    for (const Model& model : sceneModels)
+    {
+        for (const auto& texture : { model.texture0, model.texture1, model.texture2 })
+        {
+            if (texture && std::find(textures.begin(), textures.end(), texture) == textures.end())
+                textures.push_back(texture);
+        }
+    }
+
+    auto arrays = TextureArrayPacker::pack(textures);
+    textureArrays.insert(textureArrays.end(), arrays.begin(), arrays.end());
+
+    for (Model& model : sceneModels)
+    {
+        const std::shared_ptr<Texture>* slots[3] = { &model.texture0, &model.texture1, &model.texture2 };
+        for (int slot = 0; slot < 3; ++slot)
+            model.textureLayers[slot] = *slots[slot] ? (*slots[slot])->layer : -1;
+    }
 }
 
 CollisionResult Scene::checkPlayerCollision(Model& playerModel) {
     CollisionResult result = { false, glm::vec3(0.0f) };
 
+    // Only the cells around the player, the first overlapping model in scene order wins as in
+    // the linear loop below
+    if (useCollisionGrid && !collisionGrid.empty()) {
+        uint32_t first = UINT32_MAX;
+        collisionGrid.queryOverlap(playerModel.getWorldAABB(), [&first](uint32_t index) { first = std::min(first, index); });
+        if (first != UINT32_MAX) {
+            result.collided = true;
+            result.collisionNormal = glm::normalize(playerModel.position - sceneModels[first].position);
+        }
+        return result;
+    }
+
     for (Model& model : sceneModels) {
         if (Model::checkCollision(model.getTransformedAABB(), playerModel.getTransformedAABB())) {
             result.collided = true;
@@ -210,65 +503,309 @@ CollisionResult Scene::checkPlayerCollision(Model& playerModel) {
     return result;
 }
 
+std::vector<BodyCollision> Scene::checkBodyCollisions(const std::vector<Model*>& bodies)
+{
+    auto padded = [](const Model* body)
+    {
+        AABB bounds = body->getWorldAABB();
+        return AABB{ bounds.min - glm::vec3(bodyMargin), bounds.max + glm::vec3(bodyMargin) };
+    };
+
+    // Bodies keep their id while the list keeps its size, the sort then stays nearly in order
+    if (bodyBroadphase.size() != bodies.size())
+    {
+        bodyBroadphase.clear();
+        for (const Model* body : bodies)
+            bodyBroadphase.add(padded(body));
+    }
+    else
+    {
+        for (uint32_t i = 0; i < bodies.size(); ++i)
+            bodyBroadphase.update(i, padded(bodies[i]));
+    }
+
+    std::vector<BodyCollision> collisions;
+    for (const BodyPair& pair : bodyBroadphase.findPairs())
+    {
+        const Model& first = *bodies[pair.first];
+        const Model& second = *bodies[pair.second];
+        if (Model::checkCollision(first.getWorldAABB(), second.getWorldAABB()))
+            collisions.push_back({ pair.first, pair.second, glm::normalize(first.position - second.position) });
+    }
+    return collisions;
+}
+
 void Scene::render(std::shared_ptr <Camera>& camera) const
 {
+    // Camera data for every program, lights and materials only change when the scene does
+    frameUniforms.update({ projection, camera->getViewMatrix(), glm::vec4(camera->position, 1.0f) });
+    frameUniforms.bind();
+    lightUniforms.bind();
+    materialUniforms.bind();
+
     // Render the skybox first to ensure it is behind everything
     if (skybox)
     {
-        glDepthFunc(GL_LEQUAL);  // Ensure skybox is rendered first, behind everything else
-        glDisable(GL_DEPTH_TEST);  // Disable depth test to render skybox at the farthest distance
+        GLState::instance().setDepthTest(false);  // Disable depth test to render skybox at the farthest distance
 
         skyboxShader->use();
-        skyboxShader->setMat4("projection", projection);
-        skyboxShader->setMat4("view", glm::mat4(glm::mat3(camera->getViewMatrix())));  // Remove translation from view matrix
         skybox->render(skyboxShader);
 
-        glEnable(GL_DEPTH_TEST);  // Re-enable depth testing for the rest of the scene
+        GLState::instance().setDepthTest(true);  // Re-enable depth testing for the rest of the scene
+    }
+
+
+    if (camera->showOnlyColliders)
+    {
+        for (const auto& model : sceneModels)
+            model.renderAABB(coloredShader);
+        return;
     }
 
+    // Opaque draws sorted by program, textures and mesh, then front to back for early z
+    float farPlane = projection[3][2] / (projection[2][2] + 1.0f);
+    glm::mat4 view = camera->getViewMatrix();
+    cullModels(projection * view, camera->position);
+    renderQueue.clear();
+    for (size_t i = 0; i < sceneModels.size(); ++i)
+    {
+        const Model& model = sceneModels[i];
+        if (!visibility[i] || !model.mesh || !model.mesh->isUploaded())
+            continue;
 
-    for (const auto& model : sceneModels)
+        const AABB& bounds = model.getWorldAABB();
+        glm::vec3 center = glm::vec3(view * glm::vec4((bounds.min + bounds.max) * 0.5f, 1.0f));
+        renderQueue.push(RenderQueue::OpaquePass, model, *shaderFor(model), model.textureState(), model.mesh->id, -center.z / farPlane);
+    }
+    renderQueue.sort();
+
+    // Runs of two or more models become one instanced draw. With multi draw indirect, runs of
+    // pooled meshes become commands instead (one per model with --no-instancing) and every
+    // program and texture set change issues one multi draw. Instances and commands are collected first so each buffer is uploaded
+    // once per frame.
+    bool multiDraw = MultiDrawIndirect::available();
+    drawBatches.clear();
+    instanceData.clear();
+    drawCommands.clear();
+    drawData.clear();
+    renderQueue.submitBatches([this, multiDraw](const RenderQueue::Packet* const* run, size_t count)
     {
-        if (camera->showOnlyColliders) {
-            model.renderAABB(projection, camera->getViewMatrix(), coloredShader);
+        const Model& first = *run[0]->model;
+        if (multiDraw && first.mesh->pooled)
+        {
+            DrawBatch* batch = drawBatches.empty() ? nullptr : &drawBatches.back();
+            if (!batch || batch->kind != DrawBatch::MultiDraw || batch->packet->shader != run[0]->shader ||
+                batch->packet->model->textureState() != first.textureState())
+            {
+                drawBatches.push_back({ DrawBatch::MultiDraw, run[0], drawCommands.size(), 0, 0 });
+                batch = &drawBatches.back();
+            }
+
+            // Without instancing every model gets its own command with one instance
+            const Mesh& mesh = *first.mesh;
+            const VertexQuantization& q = mesh.quantization;
+            size_t perCommand = useInstancing ? count : 1;
+            for (size_t begin = 0; begin < count; begin += perCommand)
+            {
+                GLint drawIndex = static_cast<GLint>(drawCommands.size());
+                drawCommands.push_back({ static_cast<GLuint>(mesh.indexCount), static_cast<GLuint>(perCommand), mesh.firstIndex,
+                    mesh.baseVertex, static_cast<GLuint>(instanceData.size()) });
+                drawData.push_back({ glm::vec4(q.positionOffset, 0.0f), glm::vec4(q.positionScale, 0.0f),
+                    glm::vec4(q.uvOffset, q.uvScale) });
+                for (size_t i = begin; i < begin + perCommand; ++i)
+                {
+                    instanceData.push_back(run[i]->model->instanceData());
+                    instanceData.back().drawIndex = drawIndex;
+                }
+                ++batch->count;
+            }
+            batch->instances += count;
+            return;
         }
-        else
+
+        // The instanced shaders expect per draw data when multi draw is on
+        if (!useInstancing || multiDraw || count < 2)
         {
-            model.render(GetShader(model,camera), camera->position);     
+            for (size_t i = 0; i < count; ++i)
+                drawBatches.push_back({ DrawBatch::Single, run[i], 0, 0, 1 });
+            return;
         }
+        drawBatches.push_back({ DrawBatch::Instanced, run[0], instanceData.size(), static_cast<GLsizei>(count), count });
+        for (size_t i = 0; i < count; ++i)
+            instanceData.push_back(run[i]->model->instanceData());
+    });
+    instanceBuffer.upload(instanceData);
+    if (multiDraw)
+    {
+        indirectBuffer.upload(drawCommands, drawData);
+        indirectBuffer.bind(drawDataUnit);
+    }
+
+    for (const DrawBatch& batch : drawBatches)
+    {
+        const Model& model = *batch.packet->model;
+        if (batch.kind == DrawBatch::Single)
+        {
+            batch.packet->shader->use();
+            model.render(*batch.packet->shader);
+            continue;
+        }
+
+        const std::shared_ptr<Shader>& shader = instancedShaderFor(model);
+        shader->use();
+        if (batch.kind == DrawBatch::Instanced)
+        {
+            model.renderInstanced(*shader, instanceBuffer, batch.first, batch.count);
+            continue;
+        }
+
+        // Every mesh of the multi draw is in the same pool, the commands pick their ranges
+        shader->set(shader->uniformSet<ModelUniformHandles>().compactVertices, isCompact(model.mesh->format));
+        model.bindMaterial(*shader, false);
+        GLState::instance().bindVertexArray(model.mesh->VAO);
+        instanceBuffer.attach(0);
+        indirectBuffer.draw(batch.first, batch.count, batch.instances);
     }
 }
 
-std::shared_ptr<Shader> Scene::GetShader(const Model& model, std::shared_ptr <Camera>& camera) const
+// Fills visibility with one entry per model, from the BVH or from the cached world bounds
+void Scene::cullModels(const glm::mat4& viewProjection, const glm::vec3& eye) const
 {
-    std::shared_ptr<Shader> shaderToUse;
+    size_t visible = sceneModels.size();
+    if (!useFrustumCulling)
+    {
+        visibility.assign(sceneModels.size(), 1);
+    }
+    else if (useBVH && !modelBVH.empty())
+    {
+        visible = 0;
+        visibility.assign(sceneModels.size(), 0);
+        modelBVH.queryFrustum(Frustum::fromMatrix(viewProjection), [this, &visible](uint32_t index)
+        {
+            visibility[index] = 1;
+            ++visible;
+        });
+    }
+    else
+    {
+        worldBounds.resize(sceneModels.size());
+        for (size_t i = 0; i < sceneModels.size(); ++i)
+            worldBounds.set(i, sceneModels[i].getWorldAABB());
+        visible = Frustum::fromMatrix(viewProjection).cull(worldBounds, visibility);
+    }
+    cullStats = { visible, sceneModels.size() - visible };
+    if (useOcclusionCulling && !occluderCandidates.empty())
+    {
+        cullStats.occluded = cullOccluded(viewProjection, eye);
+        cullStats.visible -= cullStats.occluded;
+        cullStats.occluders = occluders.size();
+        cullStats.rasterMilliseconds = occlusionCuller.lastRasterMilliseconds();
+    }
 
+    auto now = std::chrono::steady_clock::now();
+    if (printCullStats && now - lastCullPrint >= std::chrono::seconds(1))
+    {
+        lastCullPrint = now;
+        std::cout << "Frustum culling: " << cullStats.visible << " visible, " << cullStats.culled << " culled, "
+            << cullStats.occluded << " occluded of " << sceneModels.size() << " models";
+        if (cullStats.occluders > 0)
+            std::cout << ", " << cullStats.occluders << " occluders rasterized in " << cullStats.rasterMilliseconds << " ms";
+        std::cout << std::endl;
+    }
+}
+
+// Rasterizes the largest visible occluders and clears visibility of the models behind them,
+// returns how many were
+size_t Scene::cullOccluded(const glm::mat4& viewProjection, const glm::vec3& eye) const
+{
+    // Ranked by size over distance, roughly how much of the screen they cover
+    occluders.clear();
+    for (size_t index : occluderCandidates)
+    {
+        if (!visibility[index])
+            continue;
+        const AABB& bounds = sceneModels[index].getWorldAABB();
+        glm::vec3 closest = glm::clamp(eye, bounds.min, bounds.max);
+        float size = glm::length(bounds.max - bounds.min);
+        occluders.push_back({ size / std::max(glm::length(closest - eye), 0.01f), index });
+    }
+    size_t count = std::min(occluders.size(), maxOccluders);
+    std::partial_sort(occluders.begin(), occluders.begin() + count, occluders.end(), std::greater<>());
+    occluders.resize(count);
+
+    occlusionCuller.begin(viewProjection);
+    for (const auto& occluder : occluders)
+    {
+        const Model& model = sceneModels[occluder.second];
+        occlusionCuller.rasterize(model.mesh->occluder, model.getModelMatrix());
+    }
+    occlusionCuller.end();
+
+    size_t occluded = 0;
+    for (size_t i = 0; i < sceneModels.size(); ++i)
+    {
+        if (visibility[i] && !occlusionCuller.isVisible(sceneModels[i].getWorldAABB()))
+        {
+            visibility[i] = 0;
+            ++occluded;
+        }
+    }
+    return occluded;
+}
+
+std::vector<AABB> Scene::modelBounds() const
+{
+    std::vector<AABB> bounds;
+    bounds.reserve(sceneModels.size());
+    for (const Model& model : sceneModels)
+        bounds.push_back(model.getWorldAABB());
+    return bounds;
+}
+
+BVH::RayHit Scene::raycast(const glm::vec3& origin, const glm::vec3& direction, float maxDistance) const
+{
+    return modelBVH.raycast(origin, direction, maxDistance);
+}
+
+std::shared_ptr<Shader> Scene::GetShader(const Model& model) const
+{
+    const std::shared_ptr<Shader>& shaderToUse = shaderFor(model);
+    shaderToUse->use();
+
+    return shaderToUse;
+}
+
+const std::shared_ptr<Shader>& Scene::shaderFor(const Model& model) const
+{
     // Determine the shader to use based on the model type
     switch (model.modelType)
     {
-    case Colored:
-        shaderToUse = coloredShader;
-        break;
     case Textured:
-        shaderToUse = texturedShader;
-        break;
+        return texturedShader;
     case DoubleTextured:
-        shaderToUse = doubletexturedShader;
-        break;
+        return doubletexturedShader;
     case Parallax:
-        shaderToUse = parallaxShader;
-        break;
+        return parallaxShader;
+    case Colored:
     default:
-        shaderToUse = coloredShader;
-        break;
+        return coloredShader;
     }
+}
 
-    // Common setup for the shader
-    shaderToUse->use();
-    shaderToUse->setMat4("projection", projection);
-    shaderToUse->setMat4("view", camera->getViewMatrix());
-
-    return shaderToUse;
+const std::shared_ptr<Shader>& Scene::instancedShaderFor(const Model& model) const
+{
+    switch (model.modelType)
+    {
+    case Textured:
+        return instancedTexturedShader;
+    case DoubleTextured:
+        return instancedDoubletexturedShader;
+    case Parallax:
+        return instancedParallaxShader;
+    case Colored:
+    default:
+        return instancedColoredShader;
+    }
 }
 
 void Scene::setSkybox(const std::vector<std::string>& skyboxTextures)
@@ -6,19 +6,57 @@
 #include <fstream>
 #include <sstream>
 #include <iostream>
-#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+#include <algorithm>
+#include <cstdint>
+#include <type_traits>
 #include <stdexcept>
 #include <filesystem>
+#include <memory>
 #include <glm/glm.hpp>
+#include "GLState.h"
+#include "UniformBlocks.h"
+
+// FNV-1a, constexpr so names written as UniformId constants are hashed at compile time
+constexpr uint32_t hashUniformName(const char* name)
+{
+    uint32_t hash = 2166136261u;
+    for (; *name; ++name)
+        hash = (hash ^ static_cast<uint8_t>(*name)) * 16777619u;
+    return hash;
+}
+
+// Uniform name with its hash, meant to be declared once as a constexpr constant
+struct UniformId
+{
+    uint32_t hash;
+    const char* name;
+
+    constexpr explicit UniformId(const char* name)
+        : hash(hashUniformName(name)), name(name)
+    {
+    }
+};
+
+// Location resolved once with Shader::uniform<T>(), the type is checked against the program in debug builds.
+// -1 when the program does not declare the uniform, setting it then does nothing.
+template <typename T>
+struct Uniform
+{
+    int location = -1;
+};
 
 class Shader
 {
 public:
     unsigned int ID;
-    Shader(const std::string& vertexPath, const std::string& fragmentPath)
+    // defines are inserted after the #version line of both stages, e.g. INSTANCED for the
+    // variant of a model shader that reads its transform from instance attributes
+    Shader(const std::string& vertexPath, const std::string& fragmentPath, const std::vector<std::string>& defines = {})
     {
-        std::string vertexCode = loadShaderSource(vertexPath);
-        std::string fragmentCode = loadShaderSource(fragmentPath);
+        std::string vertexCode = withDefines(loadShaderSource(vertexPath), defines);
+        std::string fragmentCode = withDefines(loadShaderSource(fragmentPath), defines);
 
         unsigned int vertex = compileShader(vertexCode, GL_VERTEX_SHADER, "VERTEX");
         unsigned int fragment = compileShader(fragmentCode, GL_FRAGMENT_SHADER, "FRAGMENT");
@@ -31,77 +69,141 @@ public:
 
         glDeleteShader(vertex);
         glDeleteShader(fragment);
+
+        reflectUniforms();
+
+        // Blocks the program does not declare are skipped
+        for (UniformBlockBinding binding : { FrameBlock, LightsBlock, MaterialsBlock })
+        {
+            unsigned int index = glGetUniformBlockIndex(ID, uniformBlockName(binding));
+            if (index != GL_INVALID_INDEX)
+                glUniformBlockBinding(ID, index, binding);
+        }
     }
 
     void use() const
     {
-        glUseProgram(ID);
+        GLState::instance().useProgram(ID);
+    }
+
+    template <typename T>
+    Uniform<T> uniform(UniformId id) const
+    {
+        return resolve<T>(id, find(id));
+    }
+
+    // Like uniform<T>() without the missing uniform warning, for names only some programs declare
+    template <typename T>
+    Uniform<T> optionalUniform(UniformId id) const
+    {
+        return resolve<T>(id, lookup(id));
+    }
+
+    bool hasUniform(UniformId id) const
+    {
+        return lookup(id) != nullptr;
+    }
+
+    // Handles of a group of uniforms, built as Set(*this) on first use and kept with the
+    // program, so per draw setters skip the name lookup
+    template <typename Set>
+    const Set& uniformSet() const
+    {
+        static const char key = 0;
+        for (const auto& entry : uniformSets)
+        {
+            if (entry.first == &key)
+                return *static_cast<const Set*>(entry.second.get());
+        }
+        auto set = std::make_shared<const Set>(*this);
+        uniformSets.emplace_back(&key, set);
+        return *set;
+    }
+
+    template <typename T>
+    void set(Uniform<T> handle, const T& value) const
+    {
+        upload(handle.location, value);
+    }
+
+    template <typename T>
+    void set(UniformId id, const T& value) const
+    {
+        upload(location(id), value);
+    }
+
+    int location(UniformId id) const
+    {
+        const UniformInfo* info = find(id);
+        return info ? info->location : -1;
     }
 
+    // String setters hash the name and search the program's uniforms on every call, hot paths
+    // use handles
     void setBool(const std::string& name, bool value) const
     {
-        glUniform1i(getUniformLocation(name), static_cast<int>(value));
+        set(UniformId(name.c_str()), value);
     }
 
     void setInt(const std::string& name, int value) const
     {
-        glUniform1i(getUniformLocation(name), value);
+        set(UniformId(name.c_str()), value);
     }
 
     void setFloat(const std::string& name, float value) const
     {
-        glUniform1f(getUniformLocation(name), value);
+        set(UniformId(name.c_str()), value);
     }
     void setVec2(const std::string& name, const glm::vec2& value) const
     {
-        glUniform2fv(glGetUniformLocation(ID, name.c_str()), 1, &value[0]);
+        set(UniformId(name.c_str()), value);
     }
     void setVec2(const std::string& name, float x, float y) const
     {
-        glUniform2f(glGetUniformLocation(ID, name.c_str()), x, y);
+        set(UniformId(name.c_str()), glm::vec2(x, y));
     }
     // ------------------------------------------------------------------------
     void setVec3(const std::string& name, const glm::vec3& value) const
     {
-        glUniform3fv(glGetUniformLocation(ID, name.c_str()), 1, &value[0]);
+        set(UniformId(name.c_str()), value);
     }
     void setVec3(const std::string& name, float x, float y, float z) const
     {
-        glUniform3f(glGetUniformLocation(ID, name.c_str()), x, y, z);
+        set(UniformId(name.c_str()), glm::vec3(x, y, z));
     }
     // ------------------------------------------------------------------------
     void setVec4(const std::string& name, const glm::vec4& value) const
     {
-        glUniform4fv(glGetUniformLocation(ID, name.c_str()), 1, &value[0]);
+        set(UniformId(name.c_str()), value);
     }
     void setVec4(const std::string& name, float x, float y, float z, float w) const
     {
-        glUniform4f(glGetUniformLocation(ID, name.c_str()), x, y, z, w);
+        set(UniformId(name.c_str()), glm::vec4(x, y, z, w));
     }
     // ------------------------------------------------------------------------
     void setMat2(const std::string& name, const glm::mat2& mat) const
     {
-        glUniformMatrix2fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, &mat[0][0]);
+        set(UniformId(name.c_str()), mat);
     }
     // ------------------------------------------------------------------------
     void setMat3(const std::string& name, const glm::mat3& mat) const
     {
-        glUniformMatrix3fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, &mat[0][0]);
+        set(UniformId(name.c_str()), mat);
     }
     // ------------------------------------------------------------------------
     void setMat4(const std::string& name, const glm::mat4& mat) const
     {
-        glUniformMatrix4fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, &mat[0][0]);
+        set(UniformId(name.c_str()), mat);
     }
 
 
     ~Shader()
     {
+        GLState::instance().forgetProgram(ID);
         glDeleteProgram(ID);
     }
 
 private:
-    mutable std::unordered_map<std::string, int> uniformLocationCache;
 
     static std::string loadShaderSource(const std::string& filePath)
     {
@@ -116,6 +218,29 @@ private:
         return shaderStream.str();
     }
 
+    static std::string withDefines(const std::string& source, const std::vector<std::string>& defines)
+    {
+        if (defines.empty())
+            return source;
+
+        std::string lines;
+        for (const std::string& define : defines)
+            lines += "#define " + define + "\n";
+
+        // #version has to stay the first statement
+        size_t position = source.find("#version");
+        if (position == std::string::npos)
+            position = 0;
+        else
+        {
+            position = source.find('\n', position);
+            position = position == std::string::npos ? source.size() : position + 1;
+        }
+        std::string result = source;
+        result.insert(position, lines);
+        return result;
+    }
+
     static unsigned int compileShader(const std::string& source, GLenum type, const std::string& shaderTypeName)
     {
         unsigned int shader = glCreateShader(type);
@@ -150,21 +275,126 @@ private:
         }
     }
 
-    int getUniformLocation(const std::string& name) const
+    struct UniformInfo
     {
-        if (uniformLocationCache.find(name) != uniformLocationCache.end())
+        uint32_t hash;
+        int location;
+        GLenum type;
+    };
+
+    std::vector<UniformInfo> uniforms;
+    mutable std::vector<std::pair<const void*, std::shared_ptr<const void>>> uniformSets;
+#ifndef NDEBUG
+    mutable std::unordered_set<uint32_t> missingUniforms;
+#endif
+
+    // Active uniforms outside blocks, sorted by name hash. Arrays are listed under their
+    // base name and under every element name.
+    void reflectUniforms()
+    {
+        GLint count = 0, maxLength = 0;
+        glGetProgramiv(ID, GL_ACTIVE_UNIFORMS, &count);
+        glGetProgramiv(ID, GL_ACTIVE_UNIFORM_MAX_LENGTH, &maxLength);
+        std::vector<char> buffer(static_cast<size_t>(std::max(maxLength, 1)));
+
+        for (GLint i = 0; i < count; ++i)
+        {
+            GLint size = 0;
+            GLenum type = 0;
+            glGetActiveUniform(ID, static_cast<GLuint>(i), maxLength, nullptr, &size, &type, buffer.data());
+            std::string name = buffer.data();
+            int location = glGetUniformLocation(ID, name.c_str());
+            if (location < 0)
+                continue;  // block member
+
+            if (name.size() > 3 && name.compare(name.size() - 3, 3, "[0]") == 0)
+            {
+                std::string base = name.substr(0, name.size() - 3);
+                addUniform(base, location, type);
+                for (GLint element = 0; element < size; ++element)
+                {
+                    std::string elementName = base + "[" + std::to_string(element) + "]";
+                    addUniform(elementName, glGetUniformLocation(ID, elementName.c_str()), type);
+                }
+            }
+            else
+            {
+                addUniform(name, location, type);
+            }
+        }
+
+        std::sort(uniforms.begin(), uniforms.end(), [](const UniformInfo& a, const UniformInfo& b) { return a.hash < b.hash; });
+        for (size_t i = 1; i < uniforms.size(); ++i)
         {
-            return uniformLocationCache[name];
+            if (uniforms[i].hash == uniforms[i - 1].hash)
+                std::cerr << "WARNING::UNIFORM NAME HASH COLLISION IN PROGRAM " << ID << std::endl;
         }
+    }
+
+    void addUniform(const std::string& name, int location, GLenum type)
+    {
+        uniforms.push_back({ hashUniformName(name.c_str()), location, type });
+    }
+
+    // Binary search over the hashes
+    const UniformInfo* lookup(UniformId id) const
+    {
+        auto it = std::lower_bound(uniforms.begin(), uniforms.end(), id.hash,
+            [](const UniformInfo& info, uint32_t hash) { return info.hash < hash; });
+        return it != uniforms.end() && it->hash == id.hash ? &*it : nullptr;
+    }
+
+    const UniformInfo* find(UniformId id) const
+    {
+        if (const UniformInfo* info = lookup(id))
+            return info;
 
-        int location = glGetUniformLocation(ID, name.c_str());
-        if (location == -1)
+#ifndef NDEBUG
+        // Misspelled or optimized out, reported once per program instead of every frame
+        if (missingUniforms.insert(id.hash).second)
+            std::cerr << "WARNING::UNIFORM " << id.name << " NOT FOUND" << std::endl;
+#endif
+        return nullptr;
+    }
+
+    template <typename T>
+    static Uniform<T> resolve(UniformId id, const UniformInfo* info)
+    {
+        Uniform<T> handle;
+        if (info)
         {
-            std::cerr << "WARNING::UNIFORM " << name << " NOT FOUND" << std::endl;
+            handle.location = info->location;
+#ifndef NDEBUG
+            if (!matchesType<T>(info->type))
+                std::cerr << "WARNING::UNIFORM " << id.name << " HAS A DIFFERENT TYPE IN THE PROGRAM" << std::endl;
+#endif
         }
-        uniformLocationCache[name] = location;
-        return location;
+        return handle;
     }
+
+    template <typename T>
+    static bool matchesType(GLenum type)
+    {
+        if constexpr (std::is_same_v<T, float>) return type == GL_FLOAT;
+        else if constexpr (std::is_same_v<T, glm::vec2>) return type == GL_FLOAT_VEC2;
+        else if constexpr (std::is_same_v<T, glm::vec3>) return type == GL_FLOAT_VEC3;
+        else if constexpr (std::is_same_v<T, glm::vec4>) return type == GL_FLOAT_VEC4;
+        else if constexpr (std::is_same_v<T, glm::mat2>) return type == GL_FLOAT_MAT2;
+        else if constexpr (std::is_same_v<T, glm::mat3>) return type == GL_FLOAT_MAT3;
+        else if constexpr (std::is_same_v<T, glm::mat4>) return type == GL_FLOAT_MAT4;
+        else if constexpr (std::is_same_v<T, bool>) return type == GL_BOOL;
+        else return type != GL_FLOAT && type != GL_BOOL;  // int, also used for samplers
+    }
+
+    static void upload(int location, bool value) { glUniform1i(location, static_cast<int>(value)); }
+    static void upload(int location, int value) { glUniform1i(location, value); }
+    static void upload(int location, float value) { glUniform1f(location, value); }
+    static void upload(int location, const glm::vec2& value) { glUniform2fv(location, 1, &value[0]); }
+    static void upload(int location, const glm::vec3& value) { glUniform3fv(location, 1, &value[0]); }
+    static void upload(int location, const glm::vec4& value) { glUniform4fv(location, 1, &value[0]); }
+    static void upload(int location, const glm::mat2& mat) { glUniformMatrix2fv(location, 1, GL_FALSE, &mat[0][0]); }
+    static void upload(int location, const glm::mat3& mat) { glUniformMatrix3fv(location, 1, GL_FALSE, &mat[0][0]); }
+    static void upload(int location, const glm::mat4& mat) { glUniformMatrix4fv(location, 1, GL_FALSE, &mat[0][0]); }
 };
 
 #endif
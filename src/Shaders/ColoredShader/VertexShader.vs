@@ -5,8 +5,13 @@ layout (location = 1) in vec2 aTexCoord;
 layout (location = 2) in vec3 aColor;
 
 uniform mat4 transform;
-uniform mat4 view;
-uniform mat4 projection;
+
+layout (std140) uniform Frame
+{
+    mat4 projection;
+    mat4 view;
+    vec3 viewPos;
+};
 
 out vec3 ourColor;
 void main()
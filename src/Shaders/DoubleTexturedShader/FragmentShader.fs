@@ -23,16 +23,53 @@ in vec2 TexCoord;
 
 out vec4 FragColor;
 
-uniform vec3 viewPos;
-uniform Material material;
-uniform Light light[4];
+layout (std140) uniform Frame
+{
+    mat4 projection;
+    mat4 view;
+    vec3 viewPos;
+};
+
+layout (std140) uniform Lights
+{
+    Light light[4];
+};
+
+layout (std140) uniform Materials
+{
+    Material materials[16];
+};
+// Instanced draws take the texture layers and material index of their instance
+#ifdef INSTANCED
+flat in ivec4 ourMaterial;
+#define textureLayer1 ourMaterial.x
+#define textureLayer2 ourMaterial.y
+#define materialIndex ourMaterial.w
+#else
+uniform int materialIndex;
+uniform int textureLayer1 = -1;
+uniform int textureLayer2 = -1;
+#endif
 uniform sampler2D texture1;
+uniform sampler2DArray textureArray1;
 uniform sampler2D texture2;
+uniform sampler2DArray textureArray2;
+
+vec4 sampleTexture1(vec2 uv)
+{
+    return textureLayer1 >= 0 ? texture(textureArray1, vec3(uv, textureLayer1)) : texture(texture1, uv);
+}
+
+vec4 sampleTexture2(vec2 uv)
+{
+    return textureLayer2 >= 0 ? texture(textureArray2, vec3(uv, textureLayer2)) : texture(texture2, uv);
+}
 
 void main()
 {
+    Material material = materials[materialIndex];
 
-    vec3 texColor =  vec3(mix(texture(texture1, TexCoord), texture(texture2, TexCoord), 0.3));
+    vec3 texColor =  vec3(mix(sampleTexture1(TexCoord), sampleTexture2(TexCoord), 0.3));
 
     vec3 norm = normalize(ourColor);
     vec3 result = vec3(0.0);
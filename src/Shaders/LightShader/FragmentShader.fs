@@ -4,7 +4,12 @@ in vec3 ourPos;
 
 out vec4 FragColor;
 
-uniform vec3 viewPos;
+layout (std140) uniform Frame
+{
+    mat4 projection;
+    mat4 view;
+    vec3 viewPos;
+};
 
 void main()
 {
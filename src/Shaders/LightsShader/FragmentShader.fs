@@ -21,12 +21,34 @@ in vec3 ourPos;
 
 out vec4 FragColor;
 
-uniform vec3 viewPos;
-uniform Material material;
-uniform Light light[4];
+layout (std140) uniform Frame
+{
+    mat4 projection;
+    mat4 view;
+    vec3 viewPos;
+};
+
+layout (std140) uniform Lights
+{
+    Light light[4];
+};
+
+layout (std140) uniform Materials
+{
+    Material materials[16];
+};
+
+// Instanced draws take the material index of their instance
+#ifdef INSTANCED
+flat in ivec4 ourMaterial;
+#define materialIndex ourMaterial.w
+#else
+uniform int materialIndex;
+#endif
 
 void main()
 {
+    Material material = materials[materialIndex];
 
    
 
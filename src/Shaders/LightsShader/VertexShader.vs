@@ -4,16 +4,66 @@ layout (location = 0) in vec3 aPos;
 layout (location = 1) in vec2 aTexCoord;
 layout (location = 2) in vec3 aColor;
 
+// Instanced draws read the model and normal matrices, texture layers and material index per
+// instance and pass the last two on to the fragment shader
+#ifdef INSTANCED
+layout (location = 5) in mat4 instanceTransform;
+layout (location = 9) in mat3 instanceNormalMatrix;
+layout (location = 12) in ivec4 instanceMaterial;
+flat out ivec4 ourMaterial;
+#else
 uniform mat4 transform;
-uniform mat4 view;
-uniform mat4 projection;
+#endif
+
+layout (std140) uniform Frame
+{
+    mat4 projection;
+    mat4 view;
+    vec3 viewPos;
+};
+
+// Compact vertices: unorm16 position/uv relative to the mesh bounds, octahedral normals
+uniform bool compactVertices;
+#ifdef MULTI_DRAW
+// One multi draw covers several meshes, each instance carries the index of its draw and the
+// draw's decode values are three texels of drawData
+layout (location = 13) in int instanceDrawIndex;
+uniform samplerBuffer drawData;
+#define positionOffset texelFetch(drawData, instanceDrawIndex * 3).xyz
+#define positionScale texelFetch(drawData, instanceDrawIndex * 3 + 1).xyz
+#define uvOffset texelFetch(drawData, instanceDrawIndex * 3 + 2).xy
+#define uvScale texelFetch(drawData, instanceDrawIndex * 3 + 2).zw
+#else
+uniform vec3 positionOffset = vec3(0.0);
+uniform vec3 positionScale = vec3(1.0);
+uniform vec2 uvOffset = vec2(0.0);
+uniform vec2 uvScale = vec2(1.0);
+#endif
+
+vec3 octDecode(vec2 e)
+{
+    vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+    if (n.z < 0.0)
+        n.xy = (1.0 - abs(n.yx)) * vec2(n.x >= 0.0 ? 1.0 : -1.0, n.y >= 0.0 ? 1.0 : -1.0);
+    return normalize(n);
+}
 
 out vec3 ourColor;
 out vec3 ourPos;
 void main()
 {   
-    ourPos = vec3(transform * vec4(aPos, 1.0));
-    ourColor = mat3(transpose(inverse(transform))) * aColor;  
+    vec3 position = positionOffset + aPos * positionScale;
+    vec3 normal = compactVertices ? octDecode(aColor.xy) : aColor;
+#ifdef INSTANCED
+    mat4 transform = instanceTransform;
+    ourMaterial = instanceMaterial;
+    mat3 normalMatrix = instanceNormalMatrix;
+#else
+    mat3 normalMatrix = mat3(transpose(inverse(transform)));
+#endif
+
+    ourPos = vec3(transform * vec4(position, 1.0));
+    ourColor = normalMatrix * normal;  
     
     gl_Position = projection * view * vec4(ourPos, 1.0);
 }
@@ -23,15 +23,44 @@ in vec2 TexCoord;
 
 out vec4 FragColor;
 
-uniform vec3 viewPos;
-uniform Material material;
-uniform Light light[4];
+layout (std140) uniform Frame
+{
+    mat4 projection;
+    mat4 view;
+    vec3 viewPos;
+};
+
+layout (std140) uniform Lights
+{
+    Light light[4];
+};
+
+layout (std140) uniform Materials
+{
+    Material materials[16];
+};
+// Instanced draws take the texture layers and material index of their instance
+#ifdef INSTANCED
+flat in ivec4 ourMaterial;
+#define textureLayer1 ourMaterial.x
+#define materialIndex ourMaterial.w
+#else
+uniform int materialIndex;
+uniform int textureLayer1 = -1;
+#endif
 uniform sampler2D texture1;
+uniform sampler2DArray textureArray1;
+
+vec4 sampleTexture1(vec2 uv)
+{
+    return textureLayer1 >= 0 ? texture(textureArray1, vec3(uv, textureLayer1)) : texture(texture1, uv);
+}
 
 void main()
 {
+    Material material = materials[materialIndex];
 
-    vec3 texColor = vec3(texture(texture1, TexCoord));
+    vec3 texColor = vec3(sampleTexture1(TexCoord));
     
     vec3 norm = normalize(ourColor);
     vec3 result= vec3(0.0);
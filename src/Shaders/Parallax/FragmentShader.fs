@@ -11,8 +11,11 @@ in VS_OUT {
 } fs_in;
 
 uniform sampler2D texture1; // diffuseMap
+uniform sampler2DArray textureArray1;
 uniform sampler2D texture2; // normalMap
+uniform sampler2DArray textureArray2;
 uniform sampler2D texture3; // depthMap
+uniform sampler2DArray textureArray3;
 
 uniform float heightScale;
 
@@ -30,9 +33,51 @@ struct Light {
     vec3 specular;
 };
 
-uniform Material material;
-uniform Light light[4];
-uniform vec3 viewPos;
+layout (std140) uniform Frame
+{
+    mat4 projection;
+    mat4 view;
+    vec3 viewPos;
+};
+
+layout (std140) uniform Lights
+{
+    Light light[4];
+};
+
+layout (std140) uniform Materials
+{
+    Material materials[16];
+};
+
+// Instanced draws take the texture layers and material index of their instance
+#ifdef INSTANCED
+flat in ivec4 ourMaterial;
+#define textureLayer1 ourMaterial.x
+#define textureLayer2 ourMaterial.y
+#define textureLayer3 ourMaterial.z
+#define materialIndex ourMaterial.w
+#else
+uniform int materialIndex;
+uniform int textureLayer1 = -1;
+uniform int textureLayer2 = -1;
+uniform int textureLayer3 = -1;
+#endif
+
+vec4 sampleTexture1(vec2 uv)
+{
+    return textureLayer1 >= 0 ? texture(textureArray1, vec3(uv, textureLayer1)) : texture(texture1, uv);
+}
+
+vec4 sampleTexture2(vec2 uv)
+{
+    return textureLayer2 >= 0 ? texture(textureArray2, vec3(uv, textureLayer2)) : texture(texture2, uv);
+}
+
+vec4 sampleTexture3(vec2 uv)
+{
+    return textureLayer3 >= 0 ? texture(textureArray3, vec3(uv, textureLayer3)) : texture(texture3, uv);
+}
 
 vec2 ParallaxMapping(vec2 texCoords, vec3 viewDir)
 { 
@@ -46,18 +91,18 @@ vec2 ParallaxMapping(vec2 texCoords, vec3 viewDir)
     vec2 deltaTexCoords = P / numLayers;
 
     vec2 currentTexCoords = texCoords;
-    float currentDepthMapValue = texture(texture3, currentTexCoords).r;
+    float currentDepthMapValue = sampleTexture3(currentTexCoords).r;
 
     while (currentLayerDepth < currentDepthMapValue)
     {
         currentTexCoords -= deltaTexCoords;
-        currentDepthMapValue = texture(texture3, currentTexCoords).r;  
+        currentDepthMapValue = sampleTexture3(currentTexCoords).r;  
         currentLayerDepth += layerDepth;  
     }
 
     vec2 prevTexCoords = currentTexCoords + deltaTexCoords;
     float afterDepth = currentDepthMapValue - currentLayerDepth;
-    float beforeDepth = texture(texture3, prevTexCoords).r - currentLayerDepth + layerDepth;
+    float beforeDepth = sampleTexture3(prevTexCoords).r - currentLayerDepth + layerDepth;
 
     float weight = abs(afterDepth) / (abs(afterDepth) + abs(beforeDepth));
     return mix(prevTexCoords, currentTexCoords, weight);
@@ -65,6 +110,8 @@ vec2 ParallaxMapping(vec2 texCoords, vec3 viewDir)
 
 void main()
 {           
+    Material material = materials[materialIndex];
+
     // offset texture coordinates with Parallax Mapping
     vec3 viewDir = normalize(fs_in.TangentViewPos - fs_in.TangentFragPos);
     vec2 texCoords = fs_in.TexCoords;
@@ -73,9 +120,9 @@ void main()
     if(texCoords.x > 1.0 || texCoords.y > 1.0 || texCoords.x < 0.0 || texCoords.y < 0.0)
         discard;
 
-    // obtain normal from normal map
-    vec3 norm = texture(texture2, texCoords).rgb;
-    norm = normalize(norm * 2.0 - 1.0);   
+    // obtain normal from normal map, z is rebuilt from xy so two channel (BC5) maps work too
+    vec2 normalXY = sampleTexture2(texCoords).rg * 2.0 - 1.0;
+    vec3 norm = vec3(normalXY, sqrt(max(1.0 - dot(normalXY, normalXY), 0.0)));
    
 
 
@@ -84,12 +131,12 @@ void main()
 
     for(int i = 0; i < 4; i++)
     {
-        vec3 ambient =  light[i].ambient * texture(texture1, texCoords).rgb;
+        vec3 ambient =  light[i].ambient * sampleTexture1(texCoords).rgb;
         // calculate diffuse lighting
         vec3 TanLightPos = fs_in.TBN * light[i].position;
         vec3 lightDir = normalize(TanLightPos - fs_in.TangentFragPos);
         float diff = max(dot(norm, lightDir), 0.0);
-        vec3 diffuse = light[i].diffuse * (diff * texture(texture1, texCoords).rgb);
+        vec3 diffuse = light[i].diffuse * (diff * sampleTexture1(texCoords).rgb);
 
         // calculate specular lighting
         vec3 reflectDir = reflect(-lightDir, norm);
@@ -7,8 +7,13 @@ out vec3 ourColor;
 out vec2 TexCoord;
 
 uniform mat4 transform;
-uniform mat4 view;       
-uniform mat4 projection; 
+
+layout (std140) uniform Frame
+{
+    mat4 projection;
+    mat4 view;
+    vec3 viewPos;
+};
 
 void main()
 {
@@ -1,5 +1,6 @@
 #include "Skybox.h"
-#include <stb_image.h>  // Include stb_image for texture loading
+#include "DecodedImage.h"
+#include "PixelUploader.h"
 #include <iostream>     // For logging
 
 Skybox::Skybox(const std::vector<std::string>& faces)
@@ -54,7 +55,7 @@ Skybox::Skybox(const std::vector<std::string>& faces)
     glGenVertexArrays(1, &VAO);
     glGenBuffers(1, &VBO);
 
-    glBindVertexArray(VAO);
+    GLState::instance().bindVertexArray(VAO);
     glBindBuffer(GL_ARRAY_BUFFER, VBO);
     glBufferData(GL_ARRAY_BUFFER, sizeof(vertices), vertices, GL_STATIC_DRAW);
 
@@ -62,27 +63,36 @@ Skybox::Skybox(const std::vector<std::string>& faces)
     glEnableVertexAttribArray(0);
 
     glBindBuffer(GL_ARRAY_BUFFER, 0);
-    glBindVertexArray(0);
+    GLState::instance().bindVertexArray(0);
 }
 
 void Skybox::loadCubemap(const std::vector<std::string>& faces)
 {
     glGenTextures(1, &cubemapTexture);
-    glBindTexture(GL_TEXTURE_CUBE_MAP, cubemapTexture);
+    GLState::instance().bindTextureForUpdate(GL_TEXTURE_CUBE_MAP, cubemapTexture);
 
     for (GLuint i = 0; i < faces.size(); i++)
     {
-        int width, height, nrChannels;
-        unsigned char* data = stbi_load(faces[i].c_str(), &width, &height, &nrChannels, 0);
-        if (data)
+        DecodedImage image = DecodedImage::decode(faces[i], false);
+        if (image)
         {
-            glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, 0, GL_RGB, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, data);
-            stbi_image_free(data);
+            GLenum target = GL_TEXTURE_CUBE_MAP_POSITIVE_X + i;
+            GLenum format = image.nrChannels == 4 ? GL_RGBA : GL_RGB;
+            if (PixelUploadRing::usePixelBuffers)
+            {
+                glTexImage2D(target, 0, GL_RGB, image.width, image.height, 0, format, GL_UNSIGNED_BYTE, nullptr);
+                PixelUploadRing::instance().upload(target, 0, image.width, image.height, format, image.nrChannels, image.pixels.get());
+            }
+            else
+            {
+                glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+                glTexImage2D(target, 0, GL_RGB, image.width, image.height, 0, format, GL_UNSIGNED_BYTE, image.pixels.get());
+                glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+            }
         }
         else
         {
             std::cerr << "Cubemap texture failed to load at path: " << faces[i] << std::endl;
-            stbi_image_free(data);
         }
     }
 
@@ -93,15 +103,12 @@ void Skybox::loadCubemap(const std::vector<std::string>& faces)
     glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
 }
 
+// Depth state is up to the caller, Scene draws the skybox with the depth test off
 void Skybox::render(std::shared_ptr<Shader> shaderProgram) const
 {
-    glDepthFunc(GL_LEQUAL);
-    glUseProgram(shaderProgram->ID);
+    shaderProgram->use();
 
-    glBindTexture(GL_TEXTURE_CUBE_MAP, cubemapTexture);
-    glBindVertexArray(VAO);
+    GLState::instance().bindTexture(0, GL_TEXTURE_CUBE_MAP, cubemapTexture);
+    GLState::instance().bindVertexArray(VAO);
     glDrawArrays(GL_TRIANGLES, 0, 36);
-    glBindVertexArray(0);
-
-    glDepthFunc(GL_LESS);
 }
@@ -0,0 +1,174 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+#include <glm/glm.hpp>
+#include "Mesh.h"
+
+// Uniform grid over world space boxes, hashed by cell so its size does not depend on the extent
+// of the level. Every box is listed in each cell it touches, a query visits the boxes listed in
+// the cells its own box touches, so its cost depends on the boxes nearby and not on how many
+// there are in total. Built once for static geometry, the lists of all cells share one array.
+class SpatialHashGrid {
+public:
+    // Boxes touching more cells than this (terrain, walls) are kept in one list every query checks
+    static constexpr int maxCellsPerBox = 64;
+
+    // The cell size defaults to twice the median box extent, so a typical box touches 1-8 cells
+    void build(const std::vector<AABB>& newBoxes, float newCellSize = 0.0f) {
+        boxes = newBoxes;
+        large.clear();
+        stamps.assign(boxes.size(), 0);
+        stamp = 0;
+        cellSize = newCellSize > 0.0f ? newCellSize : defaultCellSize(boxes);
+        inverseCellSize = 1.0f / cellSize;
+
+        // Two passes, counting the entries of every bucket and then filling them in
+        size_t entries = 0;
+        for (const AABB& box : boxes) {
+            size_t cells = cellCount(box);
+            entries += cells <= maxCellsPerBox ? cells : 0;
+        }
+        size_t buckets = 16;
+        while (buckets < entries * 2) {
+            buckets *= 2;
+        }
+        bucketMask = static_cast<uint32_t>(buckets - 1);
+        bucketStart.assign(buckets + 1, 0);
+
+        forEachEntry([this](uint32_t bucket, uint32_t) { ++bucketStart[bucket + 1]; });
+        for (size_t i = 1; i < bucketStart.size(); ++i) {
+            bucketStart[i] += bucketStart[i - 1];
+        }
+        items.resize(entries);
+        std::vector<uint32_t> fill(bucketStart.begin(), bucketStart.end() - 1);
+        forEachEntry([this, &fill](uint32_t bucket, uint32_t index) { items[fill[bucket]++] = index; });
+
+        for (uint32_t i = 0; i < boxes.size(); ++i) {
+            if (cellCount(boxes[i]) > maxCellsPerBox) {
+                large.push_back(i);
+            }
+        }
+    }
+
+    // Calls visit(index) once for every box overlapping box, in no particular order
+    template <typename Visit>
+    void queryOverlap(const AABB& box, Visit&& visit) const {
+        if (boxes.empty()) {
+            return;
+        }
+        // Cells hashing to the same bucket and boxes spanning several cells would repeat entries
+        if (++stamp == 0) {
+            std::fill(stamps.begin(), stamps.end(), 0);
+            stamp = 1;
+        }
+        auto check = [&](uint32_t index) {
+            if (stamps[index] != stamp) {
+                stamps[index] = stamp;
+                if (overlaps(boxes[index], box)) {
+                    visit(index);
+                }
+            }
+        };
+
+        for (uint32_t index : large) {
+            check(index);
+        }
+        glm::ivec3 lower = cell(box.min), upper = cell(box.max);
+        if (cellCount(lower, upper) > static_cast<size_t>(bucketMask) + 1) {
+            // Larger than the whole table, every bucket would be visited anyway
+            for (uint32_t index : items) {
+                check(index);
+            }
+            return;
+        }
+        for (int z = lower.z; z <= upper.z; ++z) {
+            for (int y = lower.y; y <= upper.y; ++y) {
+                for (int x = lower.x; x <= upper.x; ++x) {
+                    uint32_t bucket = hash(x, y, z) & bucketMask;
+                    for (uint32_t i = bucketStart[bucket]; i < bucketStart[bucket + 1]; ++i) {
+                        check(items[i]);
+                    }
+                }
+            }
+        }
+    }
+
+    bool empty() const {
+        return boxes.empty();
+    }
+
+    float getCellSize() const {
+        return cellSize;
+    }
+
+private:
+    glm::ivec3 cell(const glm::vec3& point) const {
+        return glm::ivec3(glm::floor(point * inverseCellSize));
+    }
+
+    size_t cellCount(const AABB& box) const {
+        return cellCount(cell(box.min), cell(box.max));
+    }
+
+    static size_t cellCount(const glm::ivec3& lower, const glm::ivec3& upper) {
+        glm::dvec3 cells = glm::dvec3(upper - lower) + 1.0;
+        double count = cells.x * cells.y * cells.z;
+        return count > 1e9 ? size_t(1e9) : static_cast<size_t>(count);
+    }
+
+    // Teschner et al., Optimized Spatial Hashing for Collision Detection of Deformable Objects
+    static uint32_t hash(int x, int y, int z) {
+        return (static_cast<uint32_t>(x) * 73856093u) ^ (static_cast<uint32_t>(y) * 19349663u) ^ (static_cast<uint32_t>(z) * 83492791u);
+    }
+
+    template <typename Entry>
+    void forEachEntry(Entry&& entry) const {
+        for (uint32_t i = 0; i < boxes.size(); ++i) {
+            glm::ivec3 lower = cell(boxes[i].min), upper = cell(boxes[i].max);
+            if (cellCount(lower, upper) > maxCellsPerBox) {
+                continue;
+            }
+            for (int z = lower.z; z <= upper.z; ++z) {
+                for (int y = lower.y; y <= upper.y; ++y) {
+                    for (int x = lower.x; x <= upper.x; ++x) {
+                        entry(hash(x, y, z) & bucketMask, i);
+                    }
+                }
+            }
+        }
+    }
+
+    static float defaultCellSize(const std::vector<AABB>& boxes) {
+        std::vector<float> extents;
+        extents.reserve(boxes.size());
+        for (const AABB& box : boxes) {
+            glm::vec3 size = box.max - box.min;
+            extents.push_back(std::max({ size.x, size.y, size.z }));
+        }
+        if (extents.empty()) {
+            return 1.0f;
+        }
+        std::nth_element(extents.begin(), extents.begin() + extents.size() / 2, extents.end());
+        float median = extents[extents.size() / 2];
+        return median > 0.0f ? median * 2.0f : 1.0f;
+    }
+
+    static bool overlaps(const AABB& a, const AABB& b) {
+        return a.min.x <= b.max.x && a.max.x >= b.min.x &&
+            a.min.y <= b.max.y && a.max.y >= b.min.y &&
+            a.min.z <= b.max.z && a.max.z >= b.min.z;
+    }
+
+    std::vector<AABB> boxes;
+    std::vector<uint32_t> bucketStart;  // items of bucket b are items[bucketStart[b], bucketStart[b + 1])
+    std::vector<uint32_t> items;
+    std::vector<uint32_t> large;
+    uint32_t bucketMask = 0;
+    float cellSize = 1.0f, inverseCellSize = 1.0f;
+    // Query stamp per box, a box already seen by the running query carries the current stamp
+    mutable std::vector<uint32_t> stamps;
+    mutable uint32_t stamp = 0;
+};
@@ -0,0 +1,325 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+#include <random>
+#include <vector>
+#include <glm/glm.hpp>
+#include "Mesh.h"
+#include "Model.h"
+
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#include <xmmintrin.h>
+#define SWEEP_SSE 1
+#endif
+
+// Two bodies whose boxes overlap, first < second
+struct BodyPair {
+    uint32_t first;
+    uint32_t second;
+
+    bool operator==(const BodyPair& other) const {
+        return first == other.first && second == other.second;
+    }
+};
+
+// Broadphase for many moving boxes. The box ends along one axis are kept sorted, between frames
+// bodies move little so an insertion sort restores the order in close to linear time. A sweep
+// over the sorted ends then only pairs up bodies whose intervals on that axis overlap and
+// checks the other two axes for those.
+class SweepAndPrune {
+public:
+    // Adds a body and returns its id, ids are consecutive from 0
+    uint32_t add(const AABB& box) {
+        uint32_t id = static_cast<uint32_t>(boxes.size());
+        boxes.push_back(box);
+        endpoints.push_back({ box.min[axis], id << 1 });
+        endpoints.push_back({ box.max[axis], (id << 1) | 1 });
+        resort = true;
+        return id;
+    }
+
+    void update(uint32_t id, const AABB& box) {
+        boxes[id] = box;
+    }
+
+    void clear() {
+        boxes.clear();
+        endpoints.clear();
+        pairs.clear();
+    }
+
+    size_t size() const {
+        return boxes.size();
+    }
+
+    // Overlapping pairs of the boxes as last updated, ordered by the sweep
+    const std::vector<BodyPair>& findPairs() {
+        if (resort) {
+            // New bodies are appended unsorted, sort once on the axis they are spread along most
+            chooseAxis();
+            refreshEndpoints();
+            std::sort(endpoints.begin(), endpoints.end(), less);
+            resort = false;
+            swaps = 0;
+        }
+        else {
+            refreshEndpoints();
+            insertionSort();
+        }
+        sweep();
+        return pairs;
+    }
+
+    // Endpoint moves of the last insertion sort, a measure of how coherent the motion was
+    size_t lastSwaps() const {
+        return swaps;
+    }
+
+    // Sort from scratch every frame instead, for comparison in the benchmark
+    void forceResort() {
+        resort = true;
+    }
+
+private:
+    struct Endpoint {
+        float value;
+        uint32_t body;  // id << 1, low bit set for the max end
+    };
+
+    // Bodies the sweep is inside of, with their extent on the other two axes copied into one
+    // array per bound so the inner loop reads them contiguously, four at a time with SSE
+    struct ActiveList {
+        std::vector<float> min1, max1, min2, max2;
+        std::vector<uint32_t> ids;
+
+        void clear() {
+            for (std::vector<float>* bound : { &min1, &max1, &min2, &max2 }) {
+                bound->clear();
+            }
+            ids.clear();
+        }
+
+        void add(std::vector<uint32_t>& slots, uint32_t id, float lower1, float upper1, float lower2, float upper2) {
+            slots[id] = static_cast<uint32_t>(ids.size());
+            min1.push_back(lower1);
+            max1.push_back(upper1);
+            min2.push_back(lower2);
+            max2.push_back(upper2);
+            ids.push_back(id);
+        }
+
+        // Moves the last body into the slot
+        void remove(std::vector<uint32_t>& slots, uint32_t slot) {
+            size_t last = ids.size() - 1;
+            slots[ids[last]] = slot;
+            min1[slot] = min1[last];
+            max1[slot] = max1[last];
+            min2[slot] = min2[last];
+            max2[slot] = max2[last];
+            ids[slot] = ids[last];
+            for (std::vector<float>* bound : { &min1, &max1, &min2, &max2 }) {
+                bound->pop_back();
+            }
+            ids.pop_back();
+        }
+
+        void overlapping(uint32_t id, float lower1, float upper1, float lower2, float upper2, std::vector<BodyPair>& pairs) const {
+            size_t i = 0;
+#if defined(SWEEP_SSE)
+            __m128 lower1s = _mm_set1_ps(lower1), upper1s = _mm_set1_ps(upper1);
+            __m128 lower2s = _mm_set1_ps(lower2), upper2s = _mm_set1_ps(upper2);
+            for (; i + 4 <= ids.size(); i += 4) {
+                __m128 overlap = _mm_and_ps(
+                    _mm_and_ps(_mm_cmple_ps(lower1s, _mm_loadu_ps(&max1[i])), _mm_cmpge_ps(upper1s, _mm_loadu_ps(&min1[i]))),
+                    _mm_and_ps(_mm_cmple_ps(lower2s, _mm_loadu_ps(&max2[i])), _mm_cmpge_ps(upper2s, _mm_loadu_ps(&min2[i]))));
+                int mask = _mm_movemask_ps(overlap);
+                for (int lane = 0; mask && lane < 4; ++lane) {
+                    if (mask & (1 << lane)) {
+                        pairs.push_back({ std::min(id, ids[i + lane]), std::max(id, ids[i + lane]) });
+                    }
+                }
+            }
+#endif
+            for (; i < ids.size(); ++i) {
+                // Without short circuiting, the outcome of each comparison is close to random
+                bool overlap = (lower1 <= max1[i]) & (upper1 >= min1[i]) & (lower2 <= max2[i]) & (upper2 >= min2[i]);
+                if (overlap) {
+                    pairs.push_back({ std::min(id, ids[i]), std::max(id, ids[i]) });
+                }
+            }
+        }
+    };
+
+    // Min ends sort before max ends of the same value, touching boxes count as overlapping
+    // like in Model::checkCollision
+    static bool less(const Endpoint& a, const Endpoint& b) {
+        return a.value < b.value || (a.value == b.value && (a.body & 1) < (b.body & 1));
+    }
+
+    void refreshEndpoints() {
+        for (Endpoint& endpoint : endpoints) {
+            const AABB& box = boxes[endpoint.body >> 1];
+            endpoint.value = endpoint.body & 1 ? box.max[axis] : box.min[axis];
+        }
+    }
+
+    void insertionSort() {
+        swaps = 0;
+        for (size_t i = 1; i < endpoints.size(); ++i) {
+            Endpoint endpoint = endpoints[i];
+            size_t j = i;
+            while (j > 0 && less(endpoint, endpoints[j - 1])) {
+                endpoints[j] = endpoints[j - 1];
+                --j;
+            }
+            swaps += i - j;
+            endpoints[j] = endpoint;
+        }
+    }
+
+    void sweep() {
+        pairs.clear();
+        active.clear();
+        activeSlot.resize(boxes.size());
+        int other1 = (axis + 1) % 3, other2 = (axis + 2) % 3;
+
+        for (const Endpoint& endpoint : endpoints) {
+            uint32_t id = endpoint.body >> 1;
+            if (endpoint.body & 1) {
+                active.remove(activeSlot, activeSlot[id]);
+                continue;
+            }
+            const AABB& box = boxes[id];
+            active.overlapping(id, box.min[other1], box.max[other1], box.min[other2], box.max[other2], pairs);
+            active.add(activeSlot, id, box.min[other1], box.max[other1], box.min[other2], box.max[other2]);
+        }
+    }
+
+    // Axis with the largest variance of box centers, the one where intervals overlap least
+    void chooseAxis() {
+        if (boxes.empty()) {
+            return;
+        }
+        glm::dvec3 sum(0.0), squares(0.0);
+        for (const AABB& box : boxes) {
+            glm::dvec3 center = glm::dvec3(box.min + box.max) * 0.5;
+            sum += center;
+            squares += center * center;
+        }
+        double count = static_cast<double>(boxes.size());
+        glm::dvec3 variance = squares / count - (sum / count) * (sum / count);
+        axis = variance.x >= variance.y && variance.x >= variance.z ? 0 : variance.y >= variance.z ? 1 : 2;
+    }
+
+    std::vector<AABB> boxes;
+    std::vector<Endpoint> endpoints;
+    std::vector<BodyPair> pairs;
+    ActiveList active;
+    std::vector<uint32_t> activeSlot;
+    int axis = 0;
+    bool resort = false;
+    size_t swaps = 0;
+};
+
+// Boxes bouncing around a cube, timing the incremental sort against sorting from scratch every
+// frame. The pairs of the first and last frame are checked against testing every pair.
+inline void benchmarkSweepAndPrune(size_t count = 10000, int frames = 100) {
+    std::mt19937 random(1234);
+    float world = std::cbrt(static_cast<float>(count)) * 4.0f;
+    std::uniform_real_distribution<float> position(-world, world);
+    std::uniform_real_distribution<float> size(0.2f, 2.0f);
+    std::uniform_real_distribution<float> speed(-0.2f, 0.2f);
+
+    std::vector<AABB> boxes(count);
+    std::vector<glm::vec3> velocities(count);
+    for (size_t i = 0; i < count; ++i) {
+        glm::vec3 center(position(random), position(random), position(random));
+        glm::vec3 half(size(random), size(random), size(random));
+        boxes[i] = { center - half, center + half };
+        velocities[i] = glm::vec3(speed(random), speed(random), speed(random));
+    }
+
+    auto step = [&]() {
+        for (size_t i = 0; i < count; ++i) {
+            glm::vec3 center = (boxes[i].min + boxes[i].max) * 0.5f + velocities[i];
+            for (int axis = 0; axis < 3; ++axis) {
+                if (center[axis] < -world || center[axis] > world) {
+                    velocities[i][axis] = -velocities[i][axis];
+                }
+            }
+            boxes[i].min += velocities[i];
+            boxes[i].max += velocities[i];
+        }
+    };
+
+    auto bruteForce = [&]() {
+        std::vector<BodyPair> pairs;
+        for (uint32_t i = 0; i < count; ++i) {
+            for (uint32_t j = i + 1; j < count; ++j) {
+                if (Model::checkCollision(boxes[i], boxes[j])) {
+                    pairs.push_back({ i, j });
+                }
+            }
+        }
+        return pairs;
+    };
+
+    auto sameAs = [](std::vector<BodyPair> pairs, const std::vector<BodyPair>& expected) {
+        auto byBodies = [](const BodyPair& a, const BodyPair& b) {
+            return a.first < b.first || (a.first == b.first && a.second < b.second);
+        };
+        std::sort(pairs.begin(), pairs.end(), byBodies);
+        return pairs == expected;
+    };
+
+    using Clock = std::chrono::high_resolution_clock;
+    auto milliseconds = [](Clock::time_point start) {
+        return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+    };
+
+    std::cout << "Sweep and prune benchmark: " << count << " moving boxes, " << frames << " frames" << std::endl;
+
+    auto start = Clock::now();
+    std::vector<BodyPair> expected = bruteForce();
+    std::cout << "  all pairs tested: " << milliseconds(start) << " ms per frame, " << expected.size() << " pairs" << std::endl;
+
+    std::vector<AABB> initial = boxes;
+    std::vector<glm::vec3> initialVelocities = velocities;
+    for (bool incremental : { true, false }) {
+        boxes = initial;
+        velocities = initialVelocities;
+
+        SweepAndPrune broadphase;
+        for (const AABB& box : boxes) {
+            broadphase.add(box);
+        }
+        bool correct = sameAs(broadphase.findPairs(), expected);
+
+        double total = 0.0;
+        size_t pairs = 0, swaps = 0;
+        for (int frame = 0; frame < frames; ++frame) {
+            step();
+            start = Clock::now();
+            for (uint32_t i = 0; i < count; ++i) {
+                broadphase.update(i, boxes[i]);
+            }
+            if (!incremental) {
+                broadphase.forceResort();
+            }
+            pairs += broadphase.findPairs().size();
+            total += milliseconds(start);
+            swaps += broadphase.lastSwaps();
+        }
+        correct = correct && sameAs(broadphase.findPairs(), bruteForce());
+
+        std::cout << "  " << (incremental ? "insertion sort" : "full sort") << ": " << total / frames << " ms per frame, "
+            << pairs / frames << " pairs";
+        if (incremental) {
+            std::cout << ", " << swaps / frames << " endpoint moves";
+        }
+        std::cout << (correct ? "" : " (RESULTS DIFFER)") << std::endl;
+    }
+}
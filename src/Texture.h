@@ -2,69 +2,164 @@
 #define TEXTURE_H
 
 #include <glad/gl.h>
+#include <algorithm>
 #include <string>
+#include <vector>
+#include <memory>
 #include <iostream>
-#include "stb_image.h"
+#include "GLState.h"
+#include "PixelUploader.h"
+#include "TextureCache.h"
+
+class TextureArray;
 
 class Texture {
 public:
-    unsigned int ID;
+    unsigned int ID = 0;
     GLenum textureType;
     bool isLoaded = false; // Flaga okrelajca, czy tekstura zostaa zaadowana
+    bool isReady = false; // false while the 1x1 placeholder is bound
+    bool failed = false; // the image could not be loaded, the placeholder stays bound
+    bool srgb = false;
+
+    int width = 0, height = 0, nrChannels = 0;
+    GLenum internalFormat = 0;
+    size_t uploadedBytes = 0;
+
+    // Source, set by TextureManager so the texture can be rebuilt (packing, streaming)
+    std::string path;
+    bool flip = true;
+    TextureUsage usage = ColorTexture;
+
+    // Set once the texture lives in a layer of a TextureArray, its own storage is freed then
+    std::shared_ptr<TextureArray> array;
+    int layer = -1;
+
+    // Streaming state: baseLevel is the chain level resident as level 0, chainBytes the size of
+    // every level of the full chain, requestedLevel the level of an upload still in flight
+    int baseLevel = 0;
+    int requestedLevel = -1;
+    std::vector<size_t> chainBytes;
 
     Texture() = default;
 
-    // Konstruktor
-    Texture(const std::string& path, GLenum type, bool flip = true)
-        : textureType(type)
+    // Bindable right away with a 1x1 white placeholder, upload() replaces it once the mip chain is loaded
+    Texture(GLenum type, bool srgb = false)
+        : textureType(type), srgb(srgb)
     {
-        if (flip) {
-            stbi_set_flip_vertically_on_load(true);
-        }
+        create();
 
-        glGenTextures(1, &ID);
-        glBindTexture(type, ID);
+        const unsigned char white[4] = { 255, 255, 255, 255 };
+        glTexImage2D(type, 0, GL_RGBA, 1, 1, 0, GL_RGBA, GL_UNSIGNED_BYTE, white);
+        isLoaded = true;
+    }
 
-        glTexParameteri(type, GL_TEXTURE_WRAP_S, GL_REPEAT);
-        glTexParameteri(type, GL_TEXTURE_WRAP_T, GL_REPEAT);
-        glTexParameteri(type, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-        glTexParameteri(type, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    void create() {
+        glGenTextures(1, &ID);
+        GLState::instance().bindTextureForUpdate(textureType, ID);
 
-        int width, height, nrChannels;
-        unsigned char* data = stbi_load(path.c_str(), &width, &height, &nrChannels, 0);
+        glTexParameteri(textureType, GL_TEXTURE_WRAP_S, GL_REPEAT);
+        glTexParameteri(textureType, GL_TEXTURE_WRAP_T, GL_REPEAT);
+        glTexParameteri(textureType, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(textureType, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    }
 
-        if (data) {
-            GLenum format = (nrChannels == 4) ? GL_RGBA : GL_RGB;
-            glTexImage2D(type, 0, format, width, height, 0, format, GL_UNSIGNED_BYTE, data);
-            glGenerateMipmap(type);
-            isLoaded = true; // Ustawienie flagi na true, gdy tekstura zostaa poprawnie zaadowana
+    // GL thread only, a mip chain from TextureCache starting at firstLevel, nothing is generated
+    // on the GPU. A texture that already has its image gets new storage, so levels dropped by
+    // streaming are freed.
+    void upload(const TextureData& data, int firstLevel = 0) {
+        if (isReady && ID) {
+            GLState::instance().forgetTexture(ID);
+            glDeleteTextures(1, &ID);
+            ID = 0;
+            create();
         }
-        else {
-            std::cerr << "Failed to load texture: " << path << std::endl;
-            isLoaded = false;
+        GLState::instance().bindTextureForUpdate(textureType, ID);
+        internalFormat = data.internalFormat;
+        if (srgb && !data.isCompressed()) {
+            internalFormat = GL_SRGB8_ALPHA8;
         }
 
-        stbi_image_free(data);
+        firstLevel = std::clamp(firstLevel, 0, static_cast<int>(data.levels.size()) - 1);
+        chainBytes.clear();
+        uploadedBytes = 0;
+        for (size_t level = 0; level < data.levels.size(); ++level) {
+            const TextureData::Level& mip = data.levels[level];
+            chainBytes.push_back(mip.size);
+            if (static_cast<int>(level) < firstLevel) {
+                continue;
+            }
+
+            GLint index = static_cast<GLint>(level) - firstLevel;
+            if (data.isCompressed()) {
+                if (PixelUploadRing::usePixelBuffers) {
+                    PixelUploadRing::instance().uploadCompressed(textureType, index, internalFormat, mip.width, mip.height, mip.data, mip.size);
+                }
+                else {
+                    glCompressedTexImage2D(textureType, index, internalFormat, mip.width, mip.height, 0, static_cast<GLsizei>(mip.size), mip.data);
+                }
+            }
+            else if (PixelUploadRing::usePixelBuffers) {
+                glTexImage2D(textureType, index, internalFormat, mip.width, mip.height, 0, data.format, GL_UNSIGNED_BYTE, nullptr);
+                PixelUploadRing::instance().upload(textureType, index, mip.width, mip.height, data.format, 4, mip.data);
+            }
+            else {
+                glTexImage2D(textureType, index, internalFormat, mip.width, mip.height, 0, data.format, GL_UNSIGNED_BYTE, mip.data);
+            }
+            uploadedBytes += mip.size;
+        }
+        glTexParameteri(textureType, GL_TEXTURE_MAX_LEVEL, static_cast<GLint>(data.levels.size()) - 1 - firstLevel);
+        glTexParameteri(textureType, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+
+        width = data.levels[firstLevel].width;
+        height = data.levels[firstLevel].height;
+        nrChannels = 0;
+        baseLevel = firstLevel;
+        requestedLevel = -1;
+        isLoaded = true;
+        isReady = true;
+    }
+
+    void packInto(std::shared_ptr<TextureArray> target, int targetLayer) {
+        if (ID) {
+            GLState::instance().forgetTexture(ID);
+            glDeleteTextures(1, &ID);
+            ID = 0;
+        }
+        array = std::move(target);
+        layer = targetLayer;
+        uploadedBytes = 0;
     }
 
     void bind(unsigned int slot = 0) const {
         if (isLoaded) {
-            glActiveTexture(GL_TEXTURE0 + slot);
-            glBindTexture(textureType, ID);
+            GLState::instance().bindTexture(slot, textureType, ID);
         }
     }
 
-    void unbind() const {
+    void unbind(unsigned int slot = 0) const {
         if (isLoaded) {
-            glBindTexture(textureType, 0);
+            GLState::instance().bindTexture(slot, textureType, 0);
         }
     }
 
+    // Bytes a decode of the top level produces (RGBA8 for cached mip chains) and the GPU footprint including the mip chain
+    size_t decodedBytes() const {
+        return static_cast<size_t>(width) * height * (nrChannels ? nrChannels : 4);
+    }
+
+    size_t gpuBytes() const {
+        return isLoaded ? uploadedBytes : 0;
+    }
+
     void destroy() {
-        if (isLoaded) {
+        if (ID) {
+            GLState::instance().forgetTexture(ID);
             glDeleteTextures(1, &ID);
-            isLoaded = false;
+            ID = 0;
         }
+        isLoaded = false;
+        isReady = false;
     }
 
     ~Texture() {
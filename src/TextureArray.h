@@ -0,0 +1,132 @@
+#pragma once
+
+#include <glad/gl.h>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <tuple>
+#include <vector>
+#include "GLState.h"
+#include "Texture.h"
+#include "TextureCache.h"
+
+// GL_TEXTURE_2D_ARRAY holding textures of the same size, format and mip count as layers.
+// Models sample it with their layer index, so models with different textures can be drawn
+// without rebinding.
+class TextureArray {
+public:
+    GLuint ID = 0;
+    int width = 0, height = 0, layers = 0, levels = 0;
+    GLenum internalFormat = 0;
+    size_t uploadedBytes = 0;
+
+    // Every entry must match the first one in size, format and level count
+    explicit TextureArray(const std::vector<const TextureData*>& images) {
+        const TextureData& first = *images[0];
+        width = first.levels[0].width;
+        height = first.levels[0].height;
+        layers = static_cast<int>(images.size());
+        levels = static_cast<int>(first.levels.size());
+        internalFormat = first.internalFormat;
+
+        glGenTextures(1, &ID);
+        GLState::instance().bindTextureForUpdate(GL_TEXTURE_2D_ARRAY, ID);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_REPEAT);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_REPEAT);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAX_LEVEL, levels - 1);
+
+        for (int level = 0; level < levels; ++level) {
+            const TextureData::Level& mip = first.levels[level];
+            GLsizei levelSize = static_cast<GLsizei>(mip.size);
+            if (first.isCompressed()) {
+                glCompressedTexImage3D(GL_TEXTURE_2D_ARRAY, level, internalFormat, mip.width, mip.height, layers, 0, levelSize * layers, nullptr);
+            }
+            else {
+                glTexImage3D(GL_TEXTURE_2D_ARRAY, level, internalFormat, mip.width, mip.height, layers, 0, first.format, GL_UNSIGNED_BYTE, nullptr);
+            }
+
+            for (int layer = 0; layer < layers; ++layer) {
+                const TextureData::Level& source = images[layer]->levels[level];
+                if (first.isCompressed()) {
+                    glCompressedTexSubImage3D(GL_TEXTURE_2D_ARRAY, level, 0, 0, layer, mip.width, mip.height, 1, internalFormat, levelSize, source.data);
+                }
+                else {
+                    glTexSubImage3D(GL_TEXTURE_2D_ARRAY, level, 0, 0, layer, mip.width, mip.height, 1, first.format, GL_UNSIGNED_BYTE, source.data);
+                }
+            }
+            uploadedBytes += mip.size * layers;
+        }
+    }
+
+    TextureArray(const TextureArray&) = delete;
+    TextureArray& operator=(const TextureArray&) = delete;
+
+    ~TextureArray() {
+        if (ID) {
+            GLState::instance().forgetTexture(ID);
+            glDeleteTextures(1, &ID);
+        }
+    }
+
+    void bind(unsigned int slot) const {
+        GLState::instance().bindTexture(slot, GL_TEXTURE_2D_ARRAY, ID);
+    }
+};
+
+namespace TextureArrayPacker {
+
+    inline bool enabled = true;
+
+    // Groups finished textures by size, format and mip count and moves every group of two or
+    // more into a shared array. The mip chains are read back from TextureCache, which is a
+    // file mapping for cached textures. Textures that stay alone keep their 2D texture.
+    inline std::vector<std::shared_ptr<TextureArray>> pack(const std::vector<std::shared_ptr<Texture>>& textures) {
+        struct Candidate {
+            std::shared_ptr<Texture> texture;
+            TextureData data;
+        };
+        std::map<std::tuple<int, int, GLenum, size_t>, std::vector<Candidate>> groups;
+
+        bool s3tc = TextureCache::s3tcSupported();
+        for (const auto& texture : textures) {
+            if (!texture || !texture->isReady || texture->array || texture->path.empty()) {
+                continue;
+            }
+            TextureData data = TextureCache::load(texture->path, texture->flip, texture->usage, s3tc && !texture->srgb);
+            if (!data || data.internalFormat != texture->internalFormat) {
+                continue;
+            }
+            auto key = std::make_tuple(data.levels[0].width, data.levels[0].height, data.internalFormat, data.levels.size());
+            groups[key].push_back({ texture, std::move(data) });
+        }
+
+        GLint maxLayers = 256;
+        glGetIntegerv(GL_MAX_ARRAY_TEXTURE_LAYERS, &maxLayers);
+
+        std::vector<std::shared_ptr<TextureArray>> arrays;
+        size_t packed = 0, bytes = 0;
+        for (auto& group : groups) {
+            std::vector<Candidate>& candidates = group.second;
+            for (size_t begin = 0; begin + 1 < candidates.size(); begin += static_cast<size_t>(maxLayers)) {
+                size_t end = std::min(candidates.size(), begin + static_cast<size_t>(maxLayers));
+                std::vector<const TextureData*> images;
+                for (size_t i = begin; i < end; ++i) {
+                    images.push_back(&candidates[i].data);
+                }
+
+                auto array = std::make_shared<TextureArray>(images);
+                for (size_t i = begin; i < end; ++i) {
+                    candidates[i].texture->packInto(array, static_cast<int>(i - begin));
+                }
+                packed += end - begin;
+                bytes += array->uploadedBytes;
+                arrays.push_back(std::move(array));
+            }
+        }
+
+        std::cout << "Texture arrays: " << packed << " textures in " << arrays.size() << " arrays, " << bytes / 1024 << " KB" << std::endl;
+        return arrays;
+    }
+}
@@ -0,0 +1,334 @@
+#pragma once
+
+#include <glad/gl.h>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+#include "BlockCompression.h"
+#include "DecodedImage.h"
+#include "MappedFile.h"
+#include "MeshCache.h"
+#include "MipBuilder.h"
+
+// S3TC is an extension, glad only loads the 3.3 core profile
+#ifndef GL_COMPRESSED_RGB_S3TC_DXT1_EXT
+#define GL_COMPRESSED_RGB_S3TC_DXT1_EXT 0x83F0
+#endif
+#ifndef GL_COMPRESSED_RGBA_S3TC_DXT5_EXT
+#define GL_COMPRESSED_RGBA_S3TC_DXT5_EXT 0x83F3
+#endif
+
+// What a texture upload consumes: a complete mip chain, block compressed or RGBA8, whose
+// levels point into the mapped cache file or into storage
+struct TextureData {
+    struct Level {
+        int width;
+        int height;
+        const uint8_t* data;
+        size_t size;
+    };
+
+    GLenum internalFormat = 0;
+    GLenum format = 0;        // pixel format of uncompressed levels, 0 when block compressed
+    std::vector<Level> levels;
+    std::vector<uint8_t> storage;
+    MappedFile file;
+
+    bool isCompressed() const {
+        return format == 0;
+    }
+
+    explicit operator bool() const {
+        return !levels.empty();
+    }
+};
+
+// Finished mip chains cached next to the source as <image>.<usage>.<bc|rgba>.ktx (KTX 1.1),
+// block compressed or RGBA8. The source identity and build settings are kept in a key/value
+// entry, the same checks as MeshCache apply. Loading a valid file is a mapping plus upload.
+namespace TextureCache {
+
+    constexpr uint32_t version = 2;
+    constexpr uint8_t ktxIdentifier[12] = { 0xAB, 'K', 'T', 'X', ' ', '1', '1', 0xBB, '\r', '\n', 0x1A, '\n' };
+    constexpr char sourceKey[] = "JustDown.source";
+
+    // Compress textures when loading, otherwise upload them as RGBA8
+    inline bool compressTextures = true;
+    inline MipBuilder::Filter mipFilter = MipBuilder::KaiserFilter;
+    // Largest top level kept (quality tier), 0 = full resolution
+    inline int maxTextureSize = 0;
+
+    struct KtxHeader {
+        uint8_t identifier[12];
+        uint32_t endianness;
+        uint32_t glType;
+        uint32_t glTypeSize;
+        uint32_t glFormat;
+        uint32_t glInternalFormat;
+        uint32_t glBaseInternalFormat;
+        uint32_t pixelWidth;
+        uint32_t pixelHeight;
+        uint32_t pixelDepth;
+        uint32_t numberOfArrayElements;
+        uint32_t numberOfFaces;
+        uint32_t numberOfMipmapLevels;
+        uint32_t bytesOfKeyValueData;
+    };
+
+    struct SourceRecord {
+        uint32_t version;
+        uint32_t flip;
+        uint32_t filter;
+        int32_t maxSize;
+        uint64_t pathHash;
+        uint64_t sourceSize;
+        int64_t sourceTime;
+        uint64_t contentHash;
+    };
+
+    // GL thread only, the answer is cached for the loader threads
+    inline bool s3tcSupported() {
+        static int supported = -1;
+        if (supported < 0) {
+            supported = 0;
+            GLint count = 0;
+            glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+            for (GLint i = 0; i < count; ++i) {
+                const char* name = reinterpret_cast<const char*>(glGetStringi(GL_EXTENSIONS, i));
+                if (name && std::strcmp(name, "GL_EXT_texture_compression_s3tc") == 0) {
+                    supported = 1;
+                    break;
+                }
+            }
+            if (!supported) {
+                std::cout << "S3TC not supported, color textures stay uncompressed" << std::endl;
+            }
+        }
+        return supported == 1;
+    }
+
+    inline GLenum glFormat(BlockCompression::Format format) {
+        switch (format) {
+        case BlockCompression::BC1: return GL_COMPRESSED_RGB_S3TC_DXT1_EXT;
+        case BlockCompression::BC3: return GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+        case BlockCompression::BC4: return GL_COMPRESSED_RED_RGTC1;
+        default: return GL_COMPRESSED_RG_RGTC2;
+        }
+    }
+
+    inline GLenum baseFormat(BlockCompression::Format format) {
+        switch (format) {
+        case BlockCompression::BC1: return GL_RGB;
+        case BlockCompression::BC3: return GL_RGBA;
+        case BlockCompression::BC4: return GL_RED;
+        default: return GL_RG;
+        }
+    }
+
+    inline std::string cachePath(const std::string& sourcePath, TextureUsage usage, bool compressed) {
+        static const char* names[] = { "color", "normal", "height" };
+        return sourcePath + "." + names[usage] + (compressed ? ".bc" : ".rgba") + ".ktx";
+    }
+
+    inline bool hasAlpha(const DecodedImage& image) {
+        if (image.nrChannels != 4) {
+            return false;
+        }
+        size_t pixels = static_cast<size_t>(image.width) * image.height;
+        for (size_t i = 0; i < pixels; ++i) {
+            if (image.pixels.get()[i * 4 + 3] != 255) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    inline bool read(const std::string& path, const MeshCache::SourceInfo& source, bool flip, TextureData& data) {
+        if (!data.file.open(path) || data.file.size() < sizeof(KtxHeader)) {
+            data.file.close();
+            return false;
+        }
+
+        const uint8_t* bytes = reinterpret_cast<const uint8_t*>(data.file.data());
+        const uint8_t* end = bytes + data.file.size();
+        KtxHeader header;
+        std::memcpy(&header, bytes, sizeof(header));
+        if (std::memcmp(header.identifier, ktxIdentifier, sizeof(ktxIdentifier)) != 0 || header.endianness != 0x04030201 ||
+            (header.glType != 0 && (header.glType != GL_UNSIGNED_BYTE || header.glFormat != GL_RGBA)) ||
+            header.numberOfFaces != 1 || header.numberOfMipmapLevels == 0 ||
+            data.file.size() < sizeof(KtxHeader) + header.bytesOfKeyValueData) {
+            data.file.close();
+            return false;
+        }
+
+        // Only our own key is written, anything else means a foreign file
+        const uint8_t* keyValues = bytes + sizeof(KtxHeader);
+        SourceRecord record;
+        uint32_t pairSize = 0;
+        if (header.bytesOfKeyValueData < 4 + sizeof(sourceKey) + sizeof(record)) {
+            data.file.close();
+            return false;
+        }
+        std::memcpy(&pairSize, keyValues, 4);
+        if (pairSize != sizeof(sourceKey) + sizeof(record) || std::memcmp(keyValues + 4, sourceKey, sizeof(sourceKey)) != 0) {
+            data.file.close();
+            return false;
+        }
+        std::memcpy(&record, keyValues + 4 + sizeof(sourceKey), sizeof(record));
+
+        if (record.version != version || record.flip != (flip ? 1u : 0u) || record.filter != static_cast<uint32_t>(mipFilter) ||
+            record.maxSize != maxTextureSize || record.pathHash != source.pathHash || record.sourceSize != source.size) {
+            data.file.close();
+            return false;
+        }
+        if (record.sourceTime != source.time && record.contentHash != MeshCache::hashSource(source.path)) {
+            data.file.close();
+            return false;
+        }
+
+        const uint8_t* cursor = keyValues + header.bytesOfKeyValueData;
+        int width = static_cast<int>(header.pixelWidth), height = static_cast<int>(header.pixelHeight);
+        data.levels.clear();
+        for (uint32_t level = 0; level < header.numberOfMipmapLevels; ++level) {
+            uint32_t imageSize = 0;
+            if (end - cursor < 4) {
+                break;
+            }
+            std::memcpy(&imageSize, cursor, 4);
+            cursor += 4;
+            if (static_cast<size_t>(end - cursor) < imageSize) {
+                break;
+            }
+            data.levels.push_back({ width, height, cursor, imageSize });
+            cursor += (imageSize + 3) & ~3u;
+            width = std::max(1, width / 2);
+            height = std::max(1, height / 2);
+        }
+        if (data.levels.size() != header.numberOfMipmapLevels) {
+            data.levels.clear();
+            data.file.close();
+            return false;
+        }
+        data.internalFormat = header.glInternalFormat;
+        data.format = header.glFormat;
+        return true;
+    }
+
+    inline bool write(const std::string& path, const MeshCache::SourceInfo& source, bool flip, GLenum baseInternalFormat, const TextureData& data) {
+        KtxHeader header = {};
+        std::memcpy(header.identifier, ktxIdentifier, sizeof(ktxIdentifier));
+        header.endianness = 0x04030201;
+        header.glType = data.isCompressed() ? 0 : GL_UNSIGNED_BYTE;
+        header.glTypeSize = 1;
+        header.glFormat = data.format;
+        header.glInternalFormat = data.internalFormat;
+        header.glBaseInternalFormat = baseInternalFormat;
+        header.pixelWidth = static_cast<uint32_t>(data.levels[0].width);
+        header.pixelHeight = static_cast<uint32_t>(data.levels[0].height);
+        header.numberOfFaces = 1;
+        header.numberOfMipmapLevels = static_cast<uint32_t>(data.levels.size());
+
+        SourceRecord record = {};
+        record.version = version;
+        record.flip = flip ? 1 : 0;
+        record.filter = static_cast<uint32_t>(mipFilter);
+        record.maxSize = maxTextureSize;
+        record.pathHash = source.pathHash;
+        record.sourceSize = source.size;
+        record.sourceTime = source.time;
+        record.contentHash = MeshCache::hashSource(source.path);
+
+        uint32_t pairSize = sizeof(sourceKey) + sizeof(record);
+        uint32_t padding = (4 - pairSize % 4) % 4;
+        header.bytesOfKeyValueData = 4 + pairSize + padding;
+
+        std::ofstream file(path, std::ios::binary | std::ios::trunc);
+        if (!file) {
+            std::cerr << "Failed to write texture cache: " << path << std::endl;
+            return false;
+        }
+        const char zeros[4] = {};
+        file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        file.write(reinterpret_cast<const char*>(&pairSize), 4);
+        file.write(sourceKey, sizeof(sourceKey));
+        file.write(reinterpret_cast<const char*>(&record), sizeof(record));
+        file.write(zeros, padding);
+        for (const TextureData::Level& level : data.levels) {
+            uint32_t imageSize = static_cast<uint32_t>(level.size);
+            file.write(reinterpret_cast<const char*>(&imageSize), 4);
+            file.write(reinterpret_cast<const char*>(level.data), level.size);
+            file.write(zeros, (4 - imageSize % 4) % 4);
+        }
+        return static_cast<bool>(file);
+    }
+
+    inline BlockCompression::Format chooseFormat(TextureUsage usage, const DecodedImage& image) {
+        switch (usage) {
+        case NormalTexture: return BlockCompression::BC5;
+        case HeightTexture: return BlockCompression::BC4;
+        default: return hasAlpha(image) ? BlockCompression::BC3 : BlockCompression::BC1;
+        }
+    }
+
+    // Loader thread entry point. Returns the cached chain when valid, otherwise decodes the
+    // image, builds the mips, compresses them when the usage has a format on this driver,
+    // and stores the result. An empty result means the image could not be read.
+    inline TextureData load(const std::string& path, bool flip, TextureUsage usage, bool s3tc) {
+        TextureData data;
+        bool compress = compressTextures && (usage != ColorTexture || s3tc);
+
+        MeshCache::SourceInfo source;
+        bool hasSource = MeshCache::querySource(path, source);
+        std::string cache = cachePath(path, usage, compress);
+        if (hasSource && read(cache, source, flip, data)) {
+            return data;
+        }
+
+        DecodedImage image = DecodedImage::decode(path, flip);
+        if (!image) {
+            return data;
+        }
+
+        std::vector<MipBuilder::Level> mips = MipBuilder::build(image, usage, mipFilter, maxTextureSize);
+        GLenum baseInternalFormat = GL_RGBA;
+        std::vector<std::vector<uint8_t>> compressed;
+        if (compress) {
+            BlockCompression::Format format = chooseFormat(usage, image);
+            for (const MipBuilder::Level& mip : mips) {
+                compressed.push_back(BlockCompression::compress(format, mip.pixels.data(), mip.width, mip.height, 4));
+            }
+            data.internalFormat = glFormat(format);
+            baseInternalFormat = baseFormat(format);
+        }
+        else {
+            data.internalFormat = GL_RGBA8;
+            data.format = GL_RGBA;
+        }
+        image = DecodedImage();
+
+        // All levels go into one allocation so the level pointers stay valid when data is moved
+        auto levelBytes = [&](size_t level) -> const std::vector<uint8_t>& {
+            return compress ? compressed[level] : mips[level].pixels;
+        };
+        size_t total = 0;
+        for (size_t level = 0; level < mips.size(); ++level) {
+            total += levelBytes(level).size();
+        }
+        data.storage.reserve(total);
+        for (size_t level = 0; level < mips.size(); ++level) {
+            const std::vector<uint8_t>& bytes = levelBytes(level);
+            size_t offset = data.storage.size();
+            data.storage.insert(data.storage.end(), bytes.begin(), bytes.end());
+            data.levels.push_back({ mips[level].width, mips[level].height, nullptr, bytes.size() });
+            data.levels.back().data = data.storage.data() + offset;
+        }
+
+        if (hasSource) {
+            write(cache, source, flip, baseInternalFormat, data);
+        }
+        return data;
+    }
+}
@@ -0,0 +1,118 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include "Texture.h"
+#include "ThreadPool.h"
+
+// Decodes (and block compresses, see TextureCache) images on a worker pool and hands them
+// back to the GL thread, which uploads them from processUploads() under a per-frame time
+// budget. Textures show their 1x1 placeholder until then.
+class TextureLoader {
+public:
+    static TextureLoader& instance() {
+        static TextureLoader loader;
+        return loader;
+    }
+
+    // firstLevel and maxSize (0 = no limit) pick the top level that becomes resident, see firstResidentLevel()
+    void request(const std::shared_ptr<Texture>& texture, const std::string& path, bool flip, TextureUsage usage, bool s3tc,
+        int firstLevel = 0, int maxSize = 0) {
+        ++pending;
+        std::weak_ptr<Texture> target = texture;
+        pool.submit([this, target, path, flip, usage, s3tc, firstLevel, maxSize] {
+            TextureData data = TextureCache::load(path, flip, usage, s3tc);
+            int level = firstResidentLevel(data, firstLevel, maxSize);
+            std::lock_guard<std::mutex> lock(mutex);
+            ready.push_back({ target, path, std::move(data), level });
+        });
+    }
+
+    // First chain level at or below firstLevel that fits in maxSize, never past the last level
+    static int firstResidentLevel(const TextureData& data, int firstLevel, int maxSize) {
+        int last = static_cast<int>(data.levels.size()) - 1;
+        int level = std::min(firstLevel, last);
+        while (maxSize > 0 && level < last && std::max(data.levels[level].width, data.levels[level].height) > maxSize) {
+            ++level;
+        }
+        return std::max(level, 0);
+    }
+
+    // Uploads decoded images until budgetMs is spent. At least one is uploaded per call so
+    // loading always progresses, even with a large image and a small budget.
+    size_t processUploads(double budgetMs) {
+        auto start = std::chrono::high_resolution_clock::now();
+        size_t uploaded = 0;
+
+        for (;;) {
+            Upload upload;
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                if (ready.empty()) {
+                    break;
+                }
+                upload = std::move(ready.front());
+                ready.pop_front();
+            }
+            --pending;
+
+            auto texture = upload.texture.lock();
+            if (texture && upload.data) {
+                texture->upload(upload.data, upload.level);
+            }
+            else if (texture) {
+                // A failed streaming request keeps the levels already resident
+                texture->requestedLevel = -1;
+                texture->failed = !texture->isReady;
+                std::cerr << "Failed to load texture: " << upload.path << std::endl;
+            }
+            ++uploaded;
+
+            std::chrono::duration<double, std::milli> elapsed = std::chrono::high_resolution_clock::now() - start;
+            if (elapsed.count() >= budgetMs) {
+                break;
+            }
+        }
+        return uploaded;
+    }
+
+    // Blocks until everything requested so far is uploaded
+    void finish() {
+        while (!idle()) {
+            if (processUploads(1e9) == 0) {
+                std::this_thread::yield();
+            }
+        }
+    }
+
+    bool idle() const {
+        return pending == 0;
+    }
+
+    size_t pendingCount() const {
+        return pending;
+    }
+
+private:
+    TextureLoader() = default;
+
+    struct Upload {
+        std::weak_ptr<Texture> texture;
+        std::string path;
+        TextureData data;
+        int level = 0;
+    };
+
+    std::deque<Upload> ready;
+    std::mutex mutex;
+    std::atomic<size_t> pending{ 0 };
+    // Last so the workers are joined before the queue they push to is destroyed
+    ThreadPool pool;
+};
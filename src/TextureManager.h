@@ -0,0 +1,124 @@
+#pragma once
+
+#include <glad/gl.h>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <filesystem>
+#include <unordered_map>
+#include "Texture.h"
+#include "TextureLoader.h"
+#include "TextureStreamer.h"
+
+// Shared textures keyed on path, flip, sRGB and usage. The manager keeps its own reference, so a
+// texture stays resident after its last user is gone until evictUnused() is called.
+class TextureManager {
+public:
+    // Decode on the TextureLoader pool and upload from the frame loop instead of blocking in acquire()
+    static inline bool asyncLoading = true;
+
+    static TextureManager& instance() {
+        static TextureManager manager;
+        return manager;
+    }
+
+    std::shared_ptr<Texture> acquire(const std::string& path, GLenum type = GL_TEXTURE_2D, bool flip = true, bool srgb = false,
+        TextureUsage usage = ColorTexture) {
+        std::string normalized = std::filesystem::path(path).lexically_normal().generic_string();
+        std::string key = normalized + (flip ? "|flip" : "|noflip") + (srgb ? "|srgb" : "|linear") + "|" + std::to_string(usage);
+
+        auto it = textures.find(key);
+        if (it != textures.end()) {
+            ++hits;
+            ++it->second.hits;
+            return it->second.texture;
+        }
+
+        // sRGB color stays uncompressed, the S3TC sRGB formats are a separate extension
+        bool s3tc = !srgb && TextureCache::s3tcSupported();
+        auto texture = std::make_shared<Texture>(type, srgb);
+        texture->path = normalized;
+        texture->flip = flip;
+        texture->usage = usage;
+        // With streaming on only a small top level is loaded, the streamer raises it once the texture is on screen
+        int maxSize = TextureStreamer::enabled() ? TextureStreamer::initialSize : 0;
+        if (asyncLoading) {
+            TextureLoader::instance().request(texture, normalized, flip, usage, s3tc, 0, maxSize);
+        }
+        else {
+            TextureData data = TextureCache::load(normalized, flip, usage, s3tc);
+            if (data) {
+                texture->upload(data, TextureLoader::firstResidentLevel(data, 0, maxSize));
+            }
+            else {
+                texture->failed = true;
+                std::cerr << "Failed to load texture: " << normalized << std::endl;
+            }
+        }
+        ++loads;
+        textures.emplace(key, Entry{ texture, 0 });
+        return texture;
+    }
+
+    // Number of handles held outside the manager
+    long refCount(const std::shared_ptr<Texture>& texture) const {
+        return texture ? texture.use_count() - 1 : 0;
+    }
+
+    // Releases textures no model references anymore, returns how many were freed
+    size_t evictUnused() {
+        size_t evicted = 0;
+        for (auto it = textures.begin(); it != textures.end();) {
+            if (it->second.texture.use_count() == 1) {
+                evictedDecodedBytes += it->second.texture->decodedBytes();
+                evictedDecodedBytesSaved += it->second.hits * it->second.texture->decodedBytes();
+                evictedGpuBytesSaved += it->second.hits * it->second.texture->gpuBytes();
+                it = textures.erase(it);
+                ++evicted;
+            }
+            else {
+                ++it;
+            }
+        }
+        evictions += evicted;
+        return evicted;
+    }
+
+    size_t residentGpuBytes() const {
+        size_t bytes = 0;
+        for (const auto& entry : textures) {
+            bytes += entry.second.texture->gpuBytes();
+        }
+        return bytes;
+    }
+
+    // Byte counts only include textures whose upload has finished
+    void printStats() const {
+        size_t decodedBytes = evictedDecodedBytes, decodedBytesSaved = evictedDecodedBytesSaved, gpuBytesSaved = evictedGpuBytesSaved;
+        for (const auto& entry : textures) {
+            decodedBytes += entry.second.texture->decodedBytes();
+            decodedBytesSaved += entry.second.hits * entry.second.texture->decodedBytes();
+            gpuBytesSaved += entry.second.hits * entry.second.texture->gpuBytes();
+        }
+
+        std::cout << "Textures: " << textures.size() << " resident, " << loads << " uploads, " << hits << " shared, "
+            << evictions << " evicted, " << decodedBytes / 1024 << " KB decoded, " << residentGpuBytes() / 1024 << " KB GPU, saved "
+            << decodedBytesSaved / 1024 << " KB decode and " << gpuBytesSaved / 1024 << " KB GPU" << std::endl;
+    }
+
+private:
+    TextureManager() = default;
+
+    struct Entry {
+        std::shared_ptr<Texture> texture;
+        size_t hits;
+    };
+
+    std::unordered_map<std::string, Entry> textures;
+    size_t loads = 0;
+    size_t hits = 0;
+    size_t evictions = 0;
+    size_t evictedDecodedBytes = 0;
+    size_t evictedDecodedBytesSaved = 0;
+    size_t evictedGpuBytesSaved = 0;
+};
@@ -0,0 +1,169 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <memory>
+#include <queue>
+#include <unordered_map>
+#include <vector>
+#include "Texture.h"
+#include "TextureLoader.h"
+
+// Keeps only the mip levels the camera needs resident. Every frame the scene reports how many
+// pixels each texture covers on screen, the streamer picks the top level that matches and, if
+// the total is over budgetBytes, drops further levels from the textures that lose the least.
+// Level changes rebuild the texture from its TextureCache file on the loader pool.
+class TextureStreamer {
+public:
+    // 0 disables streaming, textures then stay fully resident
+    static inline size_t budgetBytes = 0;
+    // Largest top level loaded before the first streaming update has seen the texture on screen
+    static inline int initialSize = 64;
+
+    struct Use {
+        std::shared_ptr<Texture> texture;
+        float screenSize;  // pixels covered by the model using it
+    };
+
+    struct FrameStats {
+        size_t residentBytes = 0;
+        size_t pendingRequests = 0;
+        size_t loads = 0;
+        size_t evictions = 0;
+        size_t evictedBytes = 0;
+    };
+
+    static TextureStreamer& instance() {
+        static TextureStreamer streamer;
+        return streamer;
+    }
+
+    static bool enabled() {
+        return budgetBytes > 0;
+    }
+
+    void update(const std::vector<Use>& uses) {
+        FrameStats stats;
+        std::vector<Candidate> candidates;
+        std::unordered_map<Texture*, size_t> indices;
+
+        for (const Use& use : uses) {
+            Texture* texture = use.texture.get();
+            if (!texture || !texture->isReady || texture->array || texture->chainBytes.empty()) {
+                continue;
+            }
+            auto found = indices.find(texture);
+            if (found != indices.end()) {
+                candidates[found->second].screenSize = std::max(candidates[found->second].screenSize, use.screenSize);
+                continue;
+            }
+            indices.emplace(texture, candidates.size());
+            candidates.push_back({ use.texture, use.screenSize, 0.0f, 0 });
+        }
+
+        size_t total = 0;
+        for (Candidate& candidate : candidates) {
+            Texture& texture = *candidate.texture;
+            int last = static_cast<int>(texture.chainBytes.size()) - 1;
+            float topSize = static_cast<float>(std::max(texture.width, texture.height) << texture.baseLevel);
+
+            // One texel per covered pixel, drops wait for half a level of slack so the level
+            // does not flip back and forth at the boundary
+            candidate.lod = std::log2(topSize / std::max(candidate.screenSize, 1.0f));
+            int level = std::clamp(static_cast<int>(std::floor(candidate.lod)), 0, last);
+            if (level > texture.baseLevel && candidate.lod < texture.baseLevel + 1.5f) {
+                level = texture.baseLevel;
+            }
+            candidate.level = level;
+            total += chainBytesFrom(texture, level);
+        }
+
+        // Drop one level at a time from the texture that ends up closest to its ideal level
+        auto cost = [&candidates](size_t i) {
+            return candidates[i].level + 1 - candidates[i].lod;
+        };
+        auto cheaper = [&cost](size_t a, size_t b) {
+            return cost(a) > cost(b);
+        };
+        std::priority_queue<size_t, std::vector<size_t>, decltype(cheaper)> droppable(cheaper);
+        for (size_t i = 0; i < candidates.size(); ++i) {
+            if (candidates[i].level + 1 < static_cast<int>(candidates[i].texture->chainBytes.size())) {
+                droppable.push(i);
+            }
+        }
+        while (total > budgetBytes && !droppable.empty()) {
+            size_t i = droppable.top();
+            droppable.pop();
+            Candidate& candidate = candidates[i];
+            total -= candidate.texture->chainBytes[candidate.level];
+            ++candidate.level;
+            if (candidate.level + 1 < static_cast<int>(candidate.texture->chainBytes.size())) {
+                droppable.push(i);
+            }
+        }
+
+        bool s3tc = TextureCache::s3tcSupported();
+        for (const Candidate& candidate : candidates) {
+            Texture& texture = *candidate.texture;
+            stats.residentBytes += texture.gpuBytes();
+            if (candidate.level == texture.baseLevel || texture.requestedLevel >= 0) {
+                continue;
+            }
+
+            if (candidate.level > texture.baseLevel) {
+                ++stats.evictions;
+                stats.evictedBytes += chainBytesFrom(texture, texture.baseLevel) - chainBytesFrom(texture, candidate.level);
+            }
+            else {
+                ++stats.loads;
+            }
+            texture.requestedLevel = candidate.level;
+            TextureLoader::instance().request(candidate.texture, texture.path, texture.flip, texture.usage,
+                s3tc && !texture.srgb, candidate.level);
+        }
+        stats.pendingRequests = TextureLoader::instance().pendingCount();
+
+        // Printed when something was requested and once more when the requests have landed
+        bool changed = stats.loads || stats.evictions || (stats.pendingRequests == 0 && last.pendingRequests > 0);
+        totalEvictions += stats.evictions;
+        totalEvictedBytes += stats.evictedBytes;
+        last = stats;
+        if (changed) {
+            printStats();
+        }
+    }
+
+    const FrameStats& lastFrame() const {
+        return last;
+    }
+
+    void printStats() const {
+        std::cout << "Texture streaming: " << last.residentBytes / 1024 << " KB resident of " << budgetBytes / 1024 << " KB, "
+            << last.pendingRequests << " pending, " << last.loads << " loads, " << last.evictions << " evictions ("
+            << last.evictedBytes / 1024 << " KB) this frame, " << totalEvictions << " evictions ("
+            << totalEvictedBytes / 1024 << " KB) total" << std::endl;
+    }
+
+private:
+    TextureStreamer() = default;
+
+    struct Candidate {
+        std::shared_ptr<Texture> texture;
+        float screenSize;
+        float lod;
+        int level;
+    };
+
+    static size_t chainBytesFrom(const Texture& texture, int level) {
+        size_t bytes = 0;
+        for (size_t i = static_cast<size_t>(level); i < texture.chainBytes.size(); ++i) {
+            bytes += texture.chainBytes[i];
+        }
+        return bytes;
+    }
+
+    FrameStats last;
+    size_t totalEvictions = 0;
+    size_t totalEvictedBytes = 0;
+};
@@ -0,0 +1,97 @@
+#pragma once
+
+#include <glad/gl.h>
+#include <glm/glm.hpp>
+
+// std140 uniform blocks shared by the programs in src/Shaders. Shader binds every block it
+// finds by name to the binding point below, Scene fills the buffers once per frame. std140
+// aligns vec3 to 16 bytes, so vec3 members are stored as vec4 here.
+enum UniformBlockBinding
+{
+    FrameBlock = 0,
+    LightsBlock = 1,
+    MaterialsBlock = 2
+};
+
+constexpr int maxLights = 4;
+constexpr int maxMaterials = 16;
+
+struct FrameUniforms {
+    glm::mat4 projection;
+    glm::mat4 view;
+    glm::vec4 viewPos;
+};
+
+struct LightUniforms {
+    glm::vec4 position;
+    glm::vec4 ambient;
+    glm::vec4 diffuse;
+    glm::vec4 specular;
+};
+
+struct LightsUniforms {
+    LightUniforms light[maxLights];
+};
+
+// shininess fills the padding after specular, as in the std140 layout of the GLSL struct
+struct MaterialUniforms {
+    glm::vec4 ambient;
+    glm::vec4 diffuse;
+    glm::vec3 specular;
+    float shininess;
+};
+
+struct MaterialsUniforms {
+    MaterialUniforms materials[maxMaterials];
+};
+
+static_assert(sizeof(FrameUniforms) == 144, "Frame block layout does not match std140");
+static_assert(sizeof(LightUniforms) == 64, "Light struct layout does not match std140");
+static_assert(sizeof(MaterialUniforms) == 48, "Material struct layout does not match std140");
+
+inline const char* uniformBlockName(UniformBlockBinding binding) {
+    switch (binding) {
+    case FrameBlock:
+        return "Frame";
+    case LightsBlock:
+        return "Lights";
+    case MaterialsBlock:
+        return "Materials";
+    }
+    return "";
+}
+
+// One uniform buffer holding a block of type T, attached to its binding point on creation
+template <typename T>
+class UniformBuffer {
+public:
+    GLuint ID = 0;
+    UniformBlockBinding binding;
+
+    explicit UniformBuffer(UniformBlockBinding binding)
+        : binding(binding)
+    {
+        glGenBuffers(1, &ID);
+        glBindBuffer(GL_UNIFORM_BUFFER, ID);
+        glBufferData(GL_UNIFORM_BUFFER, sizeof(T), nullptr, GL_DYNAMIC_DRAW);
+        glBindBuffer(GL_UNIFORM_BUFFER, 0);
+        bind();
+    }
+
+    UniformBuffer(const UniformBuffer&) = delete;
+    UniformBuffer& operator=(const UniformBuffer&) = delete;
+
+    ~UniformBuffer() {
+        glDeleteBuffers(1, &ID);
+    }
+
+    void update(const T& data) const {
+        glBindBuffer(GL_UNIFORM_BUFFER, ID);
+        glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(T), &data);
+        glBindBuffer(GL_UNIFORM_BUFFER, 0);
+    }
+
+    void bind() const {
+        glBindBufferBase(GL_UNIFORM_BUFFER, binding, ID);
+    }
+};